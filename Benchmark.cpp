@@ -0,0 +1,637 @@
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include "Benchmark.h"
+#include "ParticleSystem.h"
+#include "ParticleManager.h"
+#include "JobPool.h"
+#include "Map.h"
+#include "Random.h"
+#include "Timer.h"
+#include "Instrument.h"
+#include "FramePacket.h"
+#include "CommandBuffer.h"
+#include "RenderRegion.h"
+#include "Chunk.h"
+#include "Lighting.h"
+#include "CharacterController.h"
+#include "Biome.h"
+#include "Decoration.h"
+#include "Generator.h"
+#include "NoiseCache.h"
+#include "Noise.h"
+#include <thread>
+
+namespace Benchmark
+{
+    void Run()
+    {
+        JobPool::Init();
+        Map::GenerateTerrain();
+
+        RandomFill();
+        Particles();
+        ParticleEmitters();
+        ParticleCollision();
+        FrameHandoff();
+        ChunkDrawRecording();
+        ChunkMeshing();
+        LightPropagation();
+        Raycasts();
+        CharacterMovement();
+        TerrainGeneration();
+        NoiseComparison();
+
+        // everything the benchmarks went through, including the zones inside the core modules
+        printf("\n");
+        Instrument::Print();
+    }
+
+    // bulk FillRange against one Range call per value
+    void RandomFill()
+    {
+        constexpr int count = 1000000;
+        constexpr int rounds = 20;
+        std::vector<float> values(count);
+        Random random(42);
+
+        auto start = Timer::Now();
+        for (int round = 0; round < rounds; round++) {
+            random.FillRange(values.data(), count, -10, 10);
+        }
+        double fill_time = Timer::SecondsSince(start);
+
+        start = Timer::Now();
+        for (int round = 0; round < rounds; round++) {
+            for (int i = 0; i < count; i++) {
+                values[i] = random.Range(-10, 10);
+            }
+        }
+        double single_time = Timer::SecondsSince(start);
+
+        printf("random: FillRange %.3f ns/value, Range %.3f ns/value\n", fill_time * 1e9 / ((double) count * rounds), single_time * 1e9 / ((double) count * rounds));
+    }
+
+    void Particles()
+    {
+        constexpr int frames = 100;
+        constexpr float delta_time = 1.f / 60.f;
+        int counts[] = { 10000, 100000, 1000000 };
+
+        printf("particles: simulate kernel (%s) vs scalar, %d frames\n", ParticleSystem::SimdPathName(), frames);
+        for (int count : counts) {
+            ParticleSystem particles(count);
+            particles.spawn_volume_size_ = vec3(40, 0, 40);
+            particles.target_velocity_ = vec3(0, -1, 0);
+            particles.lifetime_ = 1000.f;
+            particles.Burst(count);
+
+            auto start = Timer::Now();
+            for (int frame = 0; frame < frames; frame++) {
+                particles.Simulate(0, particles.Count(), delta_time);
+            }
+            double simd_time = Timer::SecondsSince(start);
+
+            start = Timer::Now();
+            for (int frame = 0; frame < frames; frame++) {
+                particles.SimulateScalar(0, particles.Count(), delta_time);
+            }
+            double scalar_time = Timer::SecondsSince(start);
+
+            double simd_ns = simd_time * 1e9 / ((double) frames * count);
+            double scalar_ns = scalar_time * 1e9 / ((double) frames * count);
+            printf("  %8d particles: %6.3f ms/frame (%.2f ns/particle), scalar %6.3f ms/frame (%.2f ns/particle), x%.2f\n",
+                count, simd_time * 1000 / frames, simd_ns, scalar_time * 1000 / frames, scalar_ns, scalar_time / simd_time);
+
+            // the first half of the buffer expires, so every live particle has to move down, then all the rest
+            particles.Simulate(0, particles.Count() / 2, particles.lifetime_);
+            start = Timer::Now();
+            particles.Compact();
+            double half_time = Timer::SecondsSince(start);
+            particles.Simulate(0, particles.Count(), particles.lifetime_);
+            start = Timer::Now();
+            particles.Compact();
+            double all_time = Timer::SecondsSince(start);
+            printf("  %8d particles: compact half expired %6.3f ms, all expired %6.3f ms\n", count, half_time * 1000, all_time * 1000);
+        }
+    }
+
+    // many emitters updated through the ParticleManager, on the JobPool
+    void ParticleEmitters()
+    {
+        constexpr int frames = 100;
+        constexpr float delta_time = 1.f / 60.f;
+        int emitter_counts[] = { 10, 100, 500 };
+        constexpr int total_particles = 1000000;
+
+        printf("particle manager: %d particles, %d worker threads, %d frames\n", total_particles, JobPool::ThreadCount(), frames);
+        for (int emitter_count : emitter_counts) {
+            ParticleManager manager;
+            int per_emitter = total_particles / emitter_count;
+            for (int i = 0; i < emitter_count; i++) {
+                ParticleSystem* system = manager.Add(new ParticleSystem(per_emitter, i + 1));
+                system->pos_ = vec3((float) i, 20, 0);
+                system->spawn_volume_size_ = vec3(40, 0, 40);
+                system->target_velocity_ = vec3(0, -1, 0);
+                system->lifetime_ = 1000.f;
+                system->spawn_rate_ = 0.0f;
+                system->Burst(per_emitter);
+            }
+
+            auto start = Timer::Now();
+            for (int frame = 0; frame < frames; frame++) {
+                manager.Simulate(delta_time);
+                manager.FillInstances(1.0f);
+            }
+            double time = Timer::SecondsSince(start);
+            printf("  %4d emitters x %7d particles: %6.3f ms/frame\n", emitter_count, per_emitter, time * 1000 / frames);
+        }
+    }
+
+    // Game and render threads exchanging packets through a FrameQueue, with fake work on both sides: the game thread
+    // spins, the render thread sleeps like it would waiting on Present. Checks that no packet is skipped, repeated or
+    // written while being read.
+    void FrameHandoff()
+    {
+        constexpr int frames = 200;
+        constexpr int instance_count = 6000;
+        constexpr double game_ms = 2.0;
+        constexpr double render_ms = 3.0;
+
+        FrameQueue queue;
+        int errors = 0;
+        std::thread render_thread([&] {
+            int expected = 0;
+            while (FramePacket* packet = queue.BeginRead()) {
+                if (packet->frame_index != expected) {
+                    errors++;
+                }
+                expected = packet->frame_index + 1;
+                std::this_thread::sleep_for(std::chrono::microseconds((int) (render_ms * 1000)));
+                // the game thread must not have touched the packet while we were "drawing"
+                for (const ParticleInstance& instance : packet->particle_instances[0]) {
+                    if (instance.age != (float) packet->frame_index) {
+                        errors++;
+                        break;
+                    }
+                }
+                queue.EndRead();
+            }
+        });
+
+        auto start = Timer::Now();
+        for (int frame = 0; frame < frames; frame++) {
+            auto game_start = Timer::Now();
+            while (Timer::SecondsSince(game_start) * 1000 < game_ms) {
+            }
+
+            FramePacket* packet = queue.BeginWrite();
+            packet->frame_index = frame;
+            packet->particle_instances.resize(1);
+            packet->particle_instances[0].assign(instance_count, ParticleInstance{ {0, 0, 0}, 0, (float) frame });
+            // nothing else to do on this thread while the render thread catches up, unlike the window's
+            while (!queue.EndWrite(1)) {
+            }
+        }
+        queue.Quit();
+        render_thread.join();
+        double time = Timer::SecondsSince(start);
+
+        printf("frame handoff: %d frames, %.1f ms game + %.1f ms render per frame\n", frames, game_ms, render_ms);
+        printf("  %.3f ms/frame with a render thread, %.3f ms/frame on a single thread, %d errors\n", time * 1000 / frames, game_ms + render_ms, errors);
+    }
+
+    // Meshing every chunk of the map at full detail, with and without ambient occlusion. Expects the map to be generated.
+    void ChunkMeshing()
+    {
+        constexpr int rounds = 5;
+        constexpr int chunk_count = Map::max_chunks_x * Map::max_chunks_y;
+        for (int i = 0; i < chunk_count; i++) {
+            Map::chunks[i]->lod_ = 0;
+        }
+
+        printf("chunk meshing: %d chunks at lod 0, %d rounds\n", chunk_count, rounds);
+        double times[2] = {};
+        for (int ambient_occlusion = 0; ambient_occlusion <= 1; ambient_occlusion++) {
+            Chunk::ambient_occlusion_ = ambient_occlusion;
+            size_t triangles = 0;
+            auto start = Timer::Now();
+            for (int round = 0; round < rounds; round++) {
+                triangles = 0;
+                for (int i = 0; i < chunk_count; i++) {
+                    Map::chunks[i]->BuildMesh();
+                    triangles += Map::chunks[i]->builder_.ind.size() / 3;
+                }
+            }
+            times[ambient_occlusion] = Timer::SecondsSince(start);
+            printf("  ambient occlusion %-3s: %.2f us/chunk, %d triangles\n", ambient_occlusion ? "on" : "off", times[ambient_occlusion] * 1e6 / (rounds * chunk_count), (int) triangles);
+        }
+        printf("  ambient occlusion cost: %+.1f%%\n", (times[1] / times[0] - 1) * 100);
+        Chunk::ambient_occlusion_ = true;
+    }
+
+    // Recording the draws of every chunk of the map into command buffers, on one thread and split in batches over the
+    // JobPool like the render thread does. Regions are laid out without a device so nothing is drawn. Expects the map
+    // to be generated.
+    void ChunkDrawRecording()
+    {
+        constexpr int rounds = 2000;
+        constexpr int regions_x = Map::max_chunks_x / RenderRegion::chunks_x;
+        constexpr int regions_y = Map::max_chunks_y / RenderRegion::chunks_y;
+        constexpr int region_count = regions_x * regions_y;
+
+        // every chunk visible at full detail, draws are not merged to get one per chunk
+        std::vector<RenderRegion*> regions;
+        for (int region_y = 0; region_y < regions_y; region_y++) {
+            for (int region_x = 0; region_x < regions_x; region_x++) {
+                regions.push_back(new RenderRegion(region_x, region_y));
+            }
+        }
+        for (int chunk_y = 0; chunk_y < Map::max_chunks_y; chunk_y++) {
+            for (int chunk_x = 0; chunk_x < Map::max_chunks_x; chunk_x++) {
+                Chunk* chunk = Map::chunk_at(chunk_x, chunk_y);
+                chunk->lod_ = 0;
+                chunk->BuildMesh();
+                int region_index = chunk_x / RenderRegion::chunks_x + (chunk_y / RenderRegion::chunks_y) * regions_x;
+                regions[region_index]->SetChunkMesh(chunk_x, chunk_y, &chunk->builder_);
+            }
+        }
+        for (RenderRegion* region : regions) {
+            region->LayoutChunks();
+        }
+        uint32_t all_visible = (1u << RenderRegion::chunk_count) - 1;
+
+        CommandBuffer single;
+        auto start = Timer::Now();
+        for (int round = 0; round < rounds; round++) {
+            single.Clear();
+            for (RenderRegion* region : regions) {
+                region->Record(&single, all_visible, false);
+            }
+        }
+        double single_time = Timer::SecondsSince(start);
+
+        std::vector<CommandBuffer> batches(JobPool::ThreadCount() + 1);
+        int batch_count = (int) batches.size();
+        start = Timer::Now();
+        for (int round = 0; round < rounds; round++) {
+            JobPool::ParallelFor(batch_count, 1, [&](int begin, int end) {
+                for (int batch = begin; batch < end; batch++) {
+                    batches[batch].Clear();
+                    for (int i = region_count * batch / batch_count; i < region_count * (batch + 1) / batch_count; i++) {
+                        regions[i]->Record(&batches[batch], all_visible, false);
+                    }
+                }
+            });
+        }
+        double batched_time = Timer::SecondsSince(start);
+
+        int batched_draws = 0;
+        for (const CommandBuffer& batch : batches) {
+            batched_draws += batch.draw_count_;
+        }
+
+        printf("chunk draw recording: %d regions, %d draws per frame\n", region_count, single.draw_count_);
+        printf("  one thread %.3f ms/frame, %d batches %.3f ms/frame (%d draws)\n", single_time * 1000 / rounds, batch_count, batched_time * 1000 / rounds, batched_draws);
+
+        for (RenderRegion* region : regions) {
+            delete region;
+        }
+    }
+
+    // terrain collision against one Map::cell_at per particle, expects the map to be generated
+    void ParticleCollision()
+    {
+        constexpr int frames = 100;
+        // small emitters over a few chunks, and big systems spread over a quarter of the map
+        struct Case { int count; float spread; };
+        Case cases[] = { { 100, 12 }, { 1000, 12 }, { 10000, 128 }, { 50000, 128 }, { 200000, 128 } };
+
+        printf("particle collision: Collide vs Map::cell_at, %d frames\n", frames);
+        for (Case test : cases) {
+            int count = test.count;
+            ParticleSystem particles(count);
+            particles.pos_ = vec3(256, 16, 256);
+            particles.spawn_volume_size_ = vec3(test.spread, 16, test.spread);
+            particles.lifetime_ = 1000.f;
+            particles.collision_ = ParticleSystem::Collision::Kill;
+            particles.Burst(count);
+
+            // same query through Map::cell_at
+            std::vector<ParticleInstance>& instances = particles.instances_;
+            instances.resize(particles.Count());
+            particles.FillInstances(0, particles.Count(), 0.0f);
+            int hits = 0;
+            auto start = Timer::Now();
+            for (int frame = 0; frame < frames; frame++) {
+                for (ParticleInstance& instance : instances) {
+                    hits += Map::cell_at((int) floorf(instance.position[0]), (int) floorf(instance.position[2]), (int) floorf(instance.position[1])) != 0;
+                }
+            }
+            double naive_time = Timer::SecondsSince(start);
+
+            // kill only flags the lifetimes, so every frame tests the same positions
+            start = Timer::Now();
+            for (int frame = 0; frame < frames; frame++) {
+                particles.Collide(0, particles.Count());
+            }
+            double collide_time = Timer::SecondsSince(start);
+
+            particles.Compact();
+            printf("  %7d particles over %3.0f cells: Collide %7.4f ms/frame, cell_at %7.4f ms/frame (%d hits, %d killed)\n",
+                count, test.spread * 2, collide_time * 1000 / frames, naive_time * 1000 / frames, hits / frames, count - particles.Count());
+        }
+    }
+
+    // Lighting the whole map from scratch, then the latency of single cell edits relit incrementally. Checks that the
+    // edits end up with the same light as a full relight. Expects the map to be generated.
+    void LightPropagation()
+    {
+        constexpr int rounds = 5;
+        constexpr int chunk_count = Map::max_chunks_x * Map::max_chunks_y;
+
+        auto start = Timer::Now();
+        for (int round = 0; round < rounds; round++) {
+            Lighting::ComputeAll();
+        }
+        printf("lighting: full map %.2f ms\n", Timer::SecondsSince(start) * 1000 / rounds);
+
+        // a few columns in the middle of the map, each edit is done then undone
+        constexpr int columns = 64;
+        struct Edit { const char* name; int z_offset; uint8_t val; };
+        Edit edits[] = {
+            { "place lamp", 1, 4 },
+            { "dig surface", 0, 0 },
+            { "roof over ground", 3, 2 },
+        };
+        for (const Edit& edit : edits) {
+            double worst = 0;
+            double total = 0;
+            int changed = 0;
+            for (int i = 0; i < columns; i++) {
+                int x = 200 + (i % 8) * 13;
+                int y = 200 + (i / 8) * 13;
+                int z = Chunk::sz - 1;
+                while (z > 0 && Map::cell_at(x, y, z) == 0) {
+                    z--;
+                }
+                z += edit.z_offset;
+                uint8_t old = Map::cell_at(x, y, z);
+
+                start = Timer::Now();
+                Lighting::SetCell(x, y, z, edit.val);
+                double time = Timer::SecondsSince(start);
+                changed += Lighting::changed_cells_;
+                Lighting::SetCell(x, y, z, old);
+                total += time;
+                worst = time > worst ? time : worst;
+            }
+            printf("  %-16s: %7.2f us avg, %7.2f us worst, %d cells relit avg\n", edit.name, total * 1e6 / columns, worst * 1e6, changed / columns);
+        }
+
+        // leave a lamp in, the incremental light must match lighting everything again
+        Lighting::SetCell(256, 256, Chunk::sz - 1, 4);
+        std::vector<uint8_t> incremental;
+        for (int i = 0; i < chunk_count; i++) {
+            incremental.insert(incremental.end(), Map::chunks[i]->light, Map::chunks[i]->light + sizeof(Map::chunks[i]->light));
+        }
+        Lighting::ComputeAll();
+        int mismatches = 0;
+        for (int i = 0; i < chunk_count; i++) {
+            mismatches += memcmp(Map::chunks[i]->light, &incremental[i * sizeof(Map::chunks[i]->light)], sizeof(Map::chunks[i]->light)) != 0;
+        }
+        printf("  incremental vs full relight: %d chunks differ\n", mismatches);
+        Lighting::SetCell(256, 256, Chunk::sz - 1, 0);
+    }
+
+    // Map::Raycast throughput, rays from above the terrain looking down at it in random directions, one by one and
+    // with RaycastBatch. Expects the map to be generated.
+    void Raycasts()
+    {
+        constexpr int count = 200000;
+        constexpr float max_dist = 64;
+        Random random(11);
+        std::vector<vec3_t> origins(count);
+        std::vector<vec3_t> dirs(count);
+        for (int i = 0; i < count; i++) {
+            origins[i] = vec3(random.Range(0, 512), random.Range(0, 512), random.Range(20, 32));
+            dirs[i] = vec3(random.Range(-1, 1), random.Range(-1, 1), random.Range(-1, 0));
+        }
+        std::vector<Map::RayHit> hits(count);
+
+        auto start = Timer::Now();
+        for (int i = 0; i < count; i++) {
+            hits[i] = Map::Raycast(origins[i], dirs[i], max_dist);
+        }
+        double single_time = Timer::SecondsSince(start);
+
+        int hit_count = 0;
+        float total_distance = 0;
+        for (const Map::RayHit& hit : hits) {
+            hit_count += hit.hit;
+            total_distance += hit.hit ? hit.distance : max_dist;
+        }
+
+        start = Timer::Now();
+        Map::RaycastBatch(origins.data(), dirs.data(), count, max_dist, hits.data());
+        double batch_time = Timer::SecondsSince(start);
+
+        printf("raycasts: %d rays, %d hits, %.1f cells avg distance\n", count, hit_count, total_distance / count);
+        printf("  one by one %.2f Mrays/s, batched on %d threads %.2f Mrays/s\n", count / single_time * 1e-6, JobPool::ThreadCount() + 1, count / batch_time * 1e-6);
+    }
+
+    // A scripted walk across the map, turning and jumping now and then, run twice from the same start: both runs must
+    // end at the same place. Expects the map to be generated.
+    void CharacterMovement()
+    {
+        constexpr int ticks = 20000;
+        constexpr float delta_time = 1.0f / 60;
+        vec3_t end_positions[2];
+        double times[2];
+        int steps_up = 0;
+        for (int run = 0; run < 2; run++) {
+            CharacterController player;
+            player.pos_ = vec3(256.5f, (float) Chunk::sz, 256.5f);
+            steps_up = 0;
+            auto start = Timer::Now();
+            for (int tick = 0; tick < ticks; tick++) {
+                float angle = (tick / 600) * 2.4f;
+                vec3_t wish = vec3(sinf(angle) * 6.0f, 0, cosf(angle) * 6.0f);
+                float previous_y = player.pos_.y;
+                player.Move(wish, tick % 150 == 0, delta_time);
+                steps_up += player.on_ground_ && player.pos_.y >= previous_y + 0.5f;
+            }
+            times[run] = Timer::SecondsSince(start);
+            end_positions[run] = player.pos_;
+        }
+        bool same = memcmp(&end_positions[0], &end_positions[1], sizeof(vec3_t)) == 0;
+        printf("character movement: %d ticks, %.3f us/tick, %d steps up, end %.3f %.3f %.3f, %s\n", ticks, times[1] * 1e6 / ticks,
+            steps_up, end_positions[1].x, end_positions[1].y, end_positions[1].z, same ? "deterministic" : "RUNS DIFFER");
+    }
+
+    // Every Generator stage over the whole map with the 2d heightmap and with the 3d density, the climate lookups with
+    // and without the region cache, then a block of chunks generated alone and the rest of the map after it. Leaves
+    // the map regenerated with the default terrain.
+    void TerrainGeneration()
+    {
+        constexpr int chunk_count = Map::max_chunks_x * Map::max_chunks_y;
+        std::vector<Chunk*> all_chunks;
+        auto reset_chunks = [&]() {
+            Generator::Reset();
+            all_chunks.clear();
+            for (int i = 0; i < chunk_count; i++) {
+                delete Map::chunks[i];
+                Map::chunks[i] = new Chunk(i % Map::max_chunks_x, i / Map::max_chunks_x);
+                all_chunks.push_back(Map::chunks[i]);
+            }
+            Biome::ClearCache();
+            Generator::ResetStats();
+        };
+        // the map is already generated, start from an empty noise cache
+        NoiseCache::Clear();
+        printf("terrain generation: %d chunks, on %d threads\n", chunk_count, JobPool::ThreadCount() + 1);
+
+        for (int density = 0; density <= 1; density++) {
+            Generator::density_terrain = density;
+            reset_chunks();
+            int structures = Decoration::structure_count_;
+            int queued_writes = Decoration::queued_write_count_;
+            Generator::Generate(all_chunks, Generator::stage_lighting);
+            printf("  %s, %d structures, %d cells queued for neighbour chunks\n", density ? "3d density" : "2d heightmap",
+                Decoration::structure_count_ - structures, Decoration::queued_write_count_ - queued_writes);
+            Generator::PrintStats();
+        }
+
+        // climate of every column straight from the noise, against the cached regions the generation reads, looked
+        // up once per chunk
+        constexpr int size_x = Map::max_chunks_x * Chunk::sx;
+        constexpr int size_y = Map::max_chunks_y * Chunk::sy;
+        float checksum[2] = {};
+        auto start = Timer::Now();
+        for (int y = 0; y < size_y; y++) {
+            for (int x = 0; x < size_x; x++) {
+                checksum[0] += Biome::SampleClimate(x, y).temperature;
+            }
+        }
+        double direct_time = Timer::SecondsSince(start);
+        start = Timer::Now();
+        for (int i = 0; i < chunk_count; i++) {
+            int chunk_x = (i % Map::max_chunks_x) * Chunk::sx;
+            int chunk_y = (i / Map::max_chunks_x) * Chunk::sy;
+            const Biome::Region* region = Biome::RegionAt(chunk_x, chunk_y);
+            for (int y = chunk_y; y < chunk_y + Chunk::sy; y++) {
+                for (int x = chunk_x; x < chunk_x + Chunk::sx; x++) {
+                    checksum[1] += region->At(x, y).temperature;
+                }
+            }
+        }
+        double cached_time = Timer::SecondsSince(start);
+        printf("  climate per column: noise %.1f ns, cached %.1f ns (%d regions, mean temperature %.3f vs %.3f)\n",
+            direct_time * 1e9 / (size_x * size_y), cached_time * 1e9 / (size_x * size_y), Biome::CachedRegionCount(),
+            checksum[0] / (size_x * size_y), checksum[1] / (size_x * size_y));
+
+        // Heightmap stage of the whole map computing the noise for every chunk, from an empty cache, and again with
+        // every tile cached like when streamed chunks come back.
+        const char* cache_runs[] = { "no cache", "cold cache", "warm cache" };
+        for (int density = 0; density <= 1; density++) {
+            Generator::density_terrain = density;
+            for (int run = 0; run < 3; run++) {
+                Generator::use_noise_cache = run > 0;
+                if (run == 1) {
+                    NoiseCache::Clear();
+                }
+                reset_chunks();
+                Generator::Generate(all_chunks, Generator::stage_heightmap);
+                NoiseCache::Stats cache = NoiseCache::GetStats();
+                int64_t lookups = cache.hits + cache.misses;
+                printf("  heightmap stage, %s, %-10s: %6.2f ms over the threads, %5.1f%% hits, %d tiles in %lld KB\n",
+                    density ? "3d density" : "2d heightmap", cache_runs[run], Timer::ToMs(Generator::stage_stats_[Generator::stage_heightmap].ticks),
+                    lookups ? cache.hits * 100.0 / lookups : 0.0, cache.tiles, (long long) cache.bytes / 1024);
+            }
+        }
+        Generator::use_noise_cache = true;
+
+        // 16x16 chunks in the middle lit, the ring around them only goes as far as the lighting and structures need
+        reset_chunks();
+        std::vector<Chunk*> block;
+        for (int chunk_y = 24; chunk_y < 40; chunk_y++) {
+            for (int chunk_x = 24; chunk_x < 40; chunk_x++) {
+                block.push_back(Map::chunk_at(chunk_x, chunk_y));
+            }
+        }
+        Generator::Generate(block, Generator::stage_lighting);
+        int at_stage[Generator::stage_count] = {};
+        for (int i = 0; i < chunk_count; i++) {
+            at_stage[Map::chunks[i]->stage_]++;
+        }
+        printf("  %d chunks requested, chunks per stage reached:", (int) block.size());
+        for (int stage = Generator::stage_none + 1; stage < Generator::stage_count; stage++) {
+            printf(" %s %d", Generator::stage_names[stage], at_stage[stage]);
+        }
+        printf("\n  then the whole map, reusing the stages done:\n");
+        Generator::ResetStats();
+        Generator::Generate(all_chunks, Generator::stage_lighting);
+        Generator::PrintStats();
+    }
+
+    // The value noise terrain uses now against simplex noise, per sample over the same points: single octaves, the 3
+    // octave sum the heightmap takes, the batch version and the 3d ones. Also checks the batch matches simplex2d.
+    void NoiseComparison()
+    {
+        constexpr int count = 1 << 20;
+        Random random(5);
+        std::vector<float> xs(count);
+        std::vector<float> ys(count);
+        std::vector<float> zs(count);
+        for (int i = 0; i < count; i++) {
+            xs[i] = random.Range(0, 512);
+            ys[i] = random.Range(0, 512);
+            zs[i] = random.Range(0, 32);
+        }
+        std::vector<float> out(count);
+        std::vector<float> out_dx(count);
+        std::vector<float> out_dy(count);
+
+        // the sum keeps the calls from being optimized away
+        float sum = 0;
+        auto time = [&](const char* name, auto&& sample) {
+            auto start = Timer::Now();
+            for (int i = 0; i < count; i++) {
+                sum += sample(i);
+            }
+            printf("  %-26s %6.2f ns/sample\n", name, Timer::SecondsSince(start) * 1e9 / count);
+        };
+
+        printf("noise: %d samples, simplex batch path %s\n", count, Noise::SimdPathName());
+        time("perlin2d", [&](int i) { return Noise::perlin2d(xs[i], ys[i], 0.03f, 1); });
+        time("simplex2d", [&](int i) { return Noise::simplex2d(xs[i] * 0.03f, ys[i] * 0.03f); });
+        time("simplex2d + derivatives", [&](int i) {
+            float dx, dy;
+            return Noise::simplex2d(xs[i] * 0.03f, ys[i] * 0.03f, &dx, &dy) + dx + dy;
+        });
+        time("perlin2d 3 octaves", [&](int i) { return Noise::perlin2d(xs[i], ys[i], 0.03f, 3); });
+        time("simplex_fbm2d 3 octaves", [&](int i) { return Noise::simplex_fbm2d(xs[i], ys[i], 0.03f, 3); });
+        time("perlin3d", [&](int i) { return Noise::perlin3d(xs[i], ys[i], zs[i], 0.05f, 1); });
+        time("simplex3d", [&](int i) { return Noise::simplex3d(xs[i] * 0.05f, ys[i] * 0.05f, zs[i] * 0.05f); });
+
+        for (int i = 0; i < count; i++) {
+            xs[i] *= 0.03f;
+            ys[i] *= 0.03f;
+        }
+        auto start = Timer::Now();
+        Noise::simplex2d_batch(xs.data(), ys.data(), count, out.data());
+        double batch_time = Timer::SecondsSince(start);
+        start = Timer::Now();
+        Noise::simplex2d_batch(xs.data(), ys.data(), count, out.data(), out_dx.data(), out_dy.data());
+        double batch_derivatives_time = Timer::SecondsSince(start);
+
+        float max_error = 0;
+        for (int i = 0; i < count; i++) {
+            float dx, dy;
+            float value = Noise::simplex2d(xs[i], ys[i], &dx, &dy);
+            max_error = fmaxf(max_error, fmaxf(fabsf(value - out[i]), fmaxf(fabsf(dx - out_dx[i]), fabsf(dy - out_dy[i]))));
+        }
+        printf("  %-26s %6.2f ns/sample, %.2f with derivatives, max difference to simplex2d %g (%.1f)\n", "simplex2d_batch",
+            batch_time * 1e9 / count, batch_derivatives_time * 1e9 / count, max_error, sum);
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// Headless benchmarks, no window or D3D device needed. Run with the -bench command line argument, results are printed
+// to stdout.
+namespace Benchmark
+{
+    void Run();
+    void RandomFill();
+    void Particles();
+    void ParticleEmitters();
+    void ParticleCollision();
+    void FrameHandoff();
+    void ChunkDrawRecording();
+    void ChunkMeshing();
+    void LightPropagation();
+    void Raycasts();
+    void CharacterMovement();
+    void TerrainGeneration();
+    void NoiseComparison();
+}
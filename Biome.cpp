@@ -0,0 +1,127 @@
+#include "Biome.h"
+#include <math.h>
+#include <mutex>
+#include <unordered_map>
+#include "Noise.h"
+#include "Instrument.h"
+
+namespace Biome
+{
+    const Params params[type_count] = {
+        //  name         temp   humid  base   scale  surface   subsurface   depth  snow line
+        { "plains",      0.5f,  0.6f,  0.0f,  1.0f,  1,        2,           0,     99 },
+        { "desert",      0.85f, 0.15f, 1.0f,  0.5f,  5,        5,           3,     99 },
+        { "tundra",      0.1f,  0.5f,  1.0f,  0.8f,  6,        2,           0,     0 },
+        { "mountains",   0.35f, 0.15f, 2.0f,  1.8f,  2,        2,           0,     18 },
+    };
+
+    static std::mutex mutex_;
+    static std::unordered_map<int64_t, Region*> regions_;
+
+    // spread of each biome around its climate, smaller makes sharper borders
+    static constexpr float biome_spread = 0.15f;
+
+    Climate SampleClimate(int x, int y)
+    {
+        // The sum of octaves stays close to 0.5, stretch it so the whole [0, 1] range gets used.
+        auto stretch = [](float value) {
+            value = (value - 0.5f) * 3.0f + 0.5f;
+            return value < 0 ? 0 : (value > 1 ? 1 : value);
+        };
+        return {
+            stretch(Noise::perlin2d(x + 2000, y, 0.004f, 2)),
+            stretch(Noise::perlin2d(x, y + 2000, 0.005f, 2)),
+        };
+    }
+
+    Climate Region::At(int x, int y) const
+    {
+        int local_x = x - region_x * region_size;
+        int local_y = y - region_y * region_size;
+        int sample_x = local_x / climate_step;
+        int sample_y = local_y / climate_step;
+        float fx = (float) (local_x % climate_step) / climate_step;
+        float fy = (float) (local_y % climate_step) / climate_step;
+        if (sample_x == samples_per_side - 1) {
+            sample_x--;
+            fx = 1;
+        }
+        if (sample_y == samples_per_side - 1) {
+            sample_y--;
+            fy = 1;
+        }
+
+        const Climate& a = samples[sample_y][sample_x];
+        const Climate& b = samples[sample_y][sample_x + 1];
+        const Climate& c = samples[sample_y + 1][sample_x];
+        const Climate& d = samples[sample_y + 1][sample_x + 1];
+        return {
+            Noise::lin_inter(Noise::lin_inter(a.temperature, b.temperature, fx), Noise::lin_inter(c.temperature, d.temperature, fx), fy),
+            Noise::lin_inter(Noise::lin_inter(a.humidity, b.humidity, fx), Noise::lin_inter(c.humidity, d.humidity, fx), fy),
+        };
+    }
+
+    const Region* RegionAt(int x, int y)
+    {
+        // floor division, so negative cells land in their own regions
+        int region_x = x >= 0 ? x / region_size : (x + 1) / region_size - 1;
+        int region_y = y >= 0 ? y / region_size : (y + 1) / region_size - 1;
+        int64_t key = ((int64_t) region_y << 32) | (uint32_t) region_x;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        Region*& region = regions_[key];
+        if (region == nullptr) {
+            INSTRUMENT_ZONE("Biome::RegionAt miss");
+            region = new Region();
+            region->region_x = region_x;
+            region->region_y = region_y;
+            for (int sample_y = 0; sample_y < samples_per_side; sample_y++) {
+                for (int sample_x = 0; sample_x < samples_per_side; sample_x++) {
+                    region->samples[sample_y][sample_x] = SampleClimate(
+                        region_x * region_size + sample_x * climate_step, region_y * region_size + sample_y * climate_step);
+                }
+            }
+        }
+        return region;
+    }
+
+    void ClearCache()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& entry : regions_) {
+            delete entry.second;
+        }
+        regions_.clear();
+    }
+
+    int CachedRegionCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return (int) regions_.size();
+    }
+
+    void Weights(Climate climate, float weights[type_count])
+    {
+        float total = 0;
+        for (int i = 0; i < type_count; i++) {
+            float dt = climate.temperature - params[i].temperature;
+            float dh = climate.humidity - params[i].humidity;
+            weights[i] = expf(-(dt * dt + dh * dh) / (biome_spread * biome_spread));
+            total += weights[i];
+        }
+        for (int i = 0; i < type_count; i++) {
+            weights[i] /= total;
+        }
+    }
+
+    Type Dominant(const float weights[type_count])
+    {
+        int best = 0;
+        for (int i = 1; i < type_count; i++) {
+            if (weights[i] > weights[best]) {
+                best = i;
+            }
+        }
+        return (Type) best;
+    }
+}
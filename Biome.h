@@ -0,0 +1,68 @@
+#pragma once
+#include <stdint.h>
+
+// Climate and biomes for terrain generation. Temperature and humidity are low frequency noise, sampled every
+// climate_step cells and cached per region so the chunks of a region share them. Each biome has its own height curve
+// and surface materials, the height curves are blended by how close the climate is to each biome.
+namespace Biome
+{
+    enum Type
+    {
+        plains,
+        desert,
+        tundra,
+        mountains,
+        type_count,
+    };
+
+    struct Params
+    {
+        const char* name;
+        // climate the biome is centered on, in [0, 1]
+        float temperature;
+        float humidity;
+        // heightmap surface height is height_base + noise height * height_scale
+        float height_base;
+        float height_scale;
+        uint8_t surface;
+        // material of the subsurface_depth cells under the surface, stone below
+        uint8_t subsurface;
+        int subsurface_depth;
+        // surface cells above this height are snow
+        int snow_line;
+    };
+    extern const Params params[type_count];
+
+    struct Climate
+    {
+        float temperature;
+        float humidity;
+    };
+
+    // cells per side of a cached region, a multiple of the chunk size so a chunk is always in a single region
+    constexpr int region_size = 64;
+    constexpr int climate_step = 8;
+    constexpr int samples_per_side = region_size / climate_step + 1;
+
+    struct Region
+    {
+        int region_x;
+        int region_y;
+        Climate samples[samples_per_side][samples_per_side];
+
+        // Climate at a map cell of the region, interpolated between the samples around it. The last row and column
+        // (x or y at the start of the next region) are in the samples too.
+        Climate At(int x, int y) const;
+    };
+
+    // Region containing the map cell, computed the first time it's asked for. Thread safe, regions stay valid until ClearCache.
+    const Region* RegionAt(int x, int y);
+    void ClearCache();
+    int CachedRegionCount();
+
+    // climate straight from the noise, what the cached regions are sampled from
+    Climate SampleClimate(int x, int y);
+    // how much each biome applies to a climate, the weights sum to 1
+    void Weights(Climate climate, float weights[type_count]);
+    Type Dominant(const float weights[type_count]);
+}
@@ -0,0 +1,117 @@
+#include "CharacterController.h"
+#include <math.h>
+#include "Instrument.h"
+
+// contacts closer than this count as touching, positions rebuilt from pos_ can be off by a rounding error
+static constexpr float contact_epsilon = 1e-4f;
+
+CharacterController::Box CharacterController::BoxAt(vec3_t pos) const
+{
+    return {
+        { pos.x - half_width_, pos.y, pos.z - half_width_ },
+        { pos.x + half_width_, pos.y + height_, pos.z + half_width_ },
+    };
+}
+
+float CharacterController::Sweep(const Box& box, int axis, float distance) const
+{
+    int axis_a = (axis + 1) % 3;
+    int axis_b = (axis + 2) % 3;
+    for (const Box& cell : cell_boxes_) {
+        // only the cells in the way, overlapping the box on the other two axes
+        if (box.min[axis_a] >= cell.max[axis_a] - contact_epsilon || box.max[axis_a] <= cell.min[axis_a] + contact_epsilon
+            || box.min[axis_b] >= cell.max[axis_b] - contact_epsilon || box.max[axis_b] <= cell.min[axis_b] + contact_epsilon) {
+            continue;
+        }
+        if (distance > 0 && box.max[axis] <= cell.min[axis] + contact_epsilon) {
+            distance = fminf(distance, fmaxf(0, cell.min[axis] - box.max[axis]));
+        } else if (distance < 0 && box.min[axis] >= cell.max[axis] - contact_epsilon) {
+            distance = fmaxf(distance, fminf(0, cell.max[axis] - box.min[axis]));
+        }
+    }
+    return distance;
+}
+
+static void Offset(float* min, float* max, float distance)
+{
+    *min += distance;
+    *max += distance;
+}
+
+void CharacterController::SlideHorizontal(Box* box, float move_x, float move_z, bool* blocked) const
+{
+    float x = Sweep(*box, 0, move_x);
+    Offset(&box->min[0], &box->max[0], x);
+    float z = Sweep(*box, 2, move_z);
+    Offset(&box->min[2], &box->max[2], z);
+    *blocked = x != move_x || z != move_z;
+}
+
+void CharacterController::Move(vec3_t wish_velocity, bool jump, float delta_time)
+{
+    INSTRUMENT_ZONE("CharacterController::Move");
+    if (jump && on_ground_) {
+        velocity_.y = jump_speed_;
+    }
+    velocity_.x = wish_velocity.x;
+    velocity_.y -= gravity_ * delta_time;
+    velocity_.z = wish_velocity.z;
+    float move_x = velocity_.x * delta_time;
+    float move_y = velocity_.y * delta_time;
+    float move_z = velocity_.z * delta_time;
+
+    // One query for every cell the move can touch, step up included. Map cells are (x, z, y) in world coordinates.
+    Box box = BoxAt(pos_);
+    Map::GatherSolidCells(
+        (int) floorf(fminf(box.min[0], box.min[0] + move_x)),
+        (int) floorf(fminf(box.min[2], box.min[2] + move_z)),
+        (int) floorf(fminf(box.min[1], box.min[1] + move_y)),
+        (int) floorf(fmaxf(box.max[0], box.max[0] + move_x)),
+        (int) floorf(fmaxf(box.max[2], box.max[2] + move_z)),
+        (int) floorf(fmaxf(box.max[1], box.max[1] + move_y) + step_height_),
+        &solid_cells_);
+    cell_boxes_.clear();
+    for (const Map::SolidCell& cell : solid_cells_) {
+        float x = (float) cell.x;
+        float y = (float) cell.z;
+        float z = (float) cell.y;
+        cell_boxes_.push_back({ { x, y, z }, { x + 1, y + 1, z + 1 } });
+    }
+
+    float y = Sweep(box, 1, move_y);
+    Offset(&box.min[1], &box.max[1], y);
+    on_ground_ = move_y < 0 && y != move_y;
+    if (y != move_y) {
+        velocity_.y = 0;
+    }
+
+    Box moved = box;
+    bool blocked;
+    SlideHorizontal(&moved, move_x, move_z, &blocked);
+
+    // Blocked on the ground: try again from step_height_ higher and come back down. Keep it if it went further.
+    if (blocked && on_ground_ && step_height_ > 0) {
+        Box stepped = box;
+        float up = Sweep(stepped, 1, step_height_);
+        Offset(&stepped.min[1], &stepped.max[1], up);
+        bool stepped_blocked;
+        SlideHorizontal(&stepped, move_x, move_z, &stepped_blocked);
+        float down = Sweep(stepped, 1, -up);
+        Offset(&stepped.min[1], &stepped.max[1], down);
+
+        float moved_dx = moved.min[0] - box.min[0];
+        float moved_dz = moved.min[2] - box.min[2];
+        float stepped_dx = stepped.min[0] - box.min[0];
+        float stepped_dz = stepped.min[2] - box.min[2];
+        if (stepped_dx * stepped_dx + stepped_dz * stepped_dz > moved_dx * moved_dx + moved_dz * moved_dz + contact_epsilon) {
+            moved = stepped;
+        }
+    }
+
+    pos_ = vec3(moved.min[0] + half_width_, moved.min[1], moved.min[2] + half_width_);
+}
+
+vec3_t CharacterController::EyePosition() const
+{
+    return vec3(pos_.x, pos_.y + eye_height_, pos_.z);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include "types.h"
+#include "Map.h"
+
+// Walking player, an axis aligned box moved through the terrain. Gravity pulls it down, it slides along the cells it
+// runs into and steps up ledges up to step_height_ high. World coordinates (y up), pos_ is the center of the bottom of
+// the box. Only reads the map, the same moves give the same positions, with or without a window.
+class CharacterController
+{
+	// axis aligned box, world coordinates
+	struct Box
+	{
+		float min[3];
+		float max[3];
+	};
+
+	// solid cells around the box for the current Move, kept to reuse the allocations
+	std::vector<Map::SolidCell> solid_cells_;
+	std::vector<Box> cell_boxes_;
+
+	Box BoxAt(vec3_t pos) const;
+	// how far box can go along axis, up to distance, before touching one of cell_boxes_
+	float Sweep(const Box& box, int axis, float distance) const;
+	void SlideHorizontal(Box* box, float move_x, float move_z, bool* blocked) const;
+
+	public:
+	vec3_t pos_ = {};
+	vec3_t velocity_ = {};
+	float half_width_ = 0.3f;
+	float height_ = 1.8f;
+	float eye_height_ = 1.6f;
+	float gravity_ = 25.0f;
+	float jump_speed_ = 8.0f;
+	float step_height_ = 1.0f;
+	bool on_ground_ = false;
+
+	// Walks at wish_velocity (its y is ignored), jumps if on the ground. Call with a fixed delta_time to stay deterministic.
+	void Move(vec3_t wish_velocity, bool jump, float delta_time);
+	vec3_t EyePosition() const;
+};
@@ -1,6 +1,11 @@
 #include "Chunk.h"
 #include <assert.h>
+#include <string.h>
 #include "Map.h"
+#include "Instrument.h"
+#include "Lighting.h"
+
+bool Chunk::ambient_occlusion_ = true;
 
 Chunk::Chunk(int chunk_x, int chunk_y)
 {
@@ -22,33 +27,115 @@ uint8_t Chunk::GetCellLocal(int x, int y, int z)
 	return cells[idx];
 }
 
-void Chunk::UpdateGeometryBuffers(ID3D11Device* device, ID3D11DeviceContext* context)
+uint8_t Chunk::GetCellLod(int x, int y, int z, int lod)
+{
+    if (lod == 0) {
+        return GetCellLocal(x, y, z);
+    }
+
+    // x, y, z are in lod cells, each one covers a block of step^3 cells. The block is solid if most of its cells are,
+    // and takes the material of its top most cell so grass stays grass from far away.
+    int step = 1 << lod;
+    int solid_count = 0;
+    uint8_t top_cell = 0;
+    for (int lz = step - 1; lz >= 0; lz--) {
+        for (int ly = 0; ly < step; ly++) {
+            for (int lx = 0; lx < step; lx++) {
+                uint8_t cell = GetCellLocal(x * step + lx, y * step + ly, z * step + lz);
+                if (cell != 0) {
+                    solid_count++;
+                    if (top_cell == 0) {
+                        top_cell = cell;
+                    }
+                }
+            }
+        }
+    }
+    return solid_count * 2 >= step * step * step ? top_cell : 0;
+}
+
+void Chunk::SetLod(int lod)
 {
-    // Create the buffers if they don't exist yet
-    if (vbuffer_ == nullptr)
-    {
-        constexpr int max_faces = 2048 * 4;
-        {
-            D3D11_BUFFER_DESC desc =
-            {
-                .ByteWidth = static_cast<UINT>(max_faces * 4 * sizeof(Vertex)),
-                .Usage = D3D11_USAGE_DYNAMIC,
-                .BindFlags = D3D11_BIND_VERTEX_BUFFER,
-                .CPUAccessFlags = D3D10_CPU_ACCESS_WRITE,
-            };
-
-            device->CreateBuffer(&desc, nullptr, &vbuffer_);
+    if (lod == lod_) {
+        return;
+    }
+    lod_ = lod;
+    dirty_ = true;
+
+    // Neighbours put a skirt on the side they share with a chunk of another lod, so they need a remesh too. The
+    // diagonal ones read their corner cell for the ambient occlusion, which is left empty at another lod.
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            Chunk* neighbour = Map::chunk_at(chunk_x_ + dx, chunk_y_ + dy);
+            if (neighbour && neighbour != this) {
+                neighbour->dirty_ = true;
+            }
         }
-        {
-            D3D11_BUFFER_DESC desc =
-            {
-                .ByteWidth = static_cast<UINT>(max_faces * 6 * sizeof(builder_.ind[0])),
-                .Usage = D3D11_USAGE_DYNAMIC,
-                .BindFlags = D3D11_BIND_INDEX_BUFFER,
-                .CPUAccessFlags = D3D10_CPU_ACCESS_WRITE,
-            };
-
-            device->CreateBuffer(&desc, nullptr, &ibuffer_);
+    }
+}
+
+int Chunk::LodForDistance(int chunk_dist_sq)
+{
+    if (chunk_dist_sq <= 8 * 8) return 0;
+    if (chunk_dist_sq <= 16 * 16) return 1;
+    if (chunk_dist_sq <= 24 * 24) return 2;
+    return 3;
+}
+
+void Chunk::BuildMesh()
+{
+    INSTRUMENT_ZONE("Chunk::BuildMesh");
+    builder_.vert.clear();
+    builder_.ind.clear();
+    dirty_ = false;
+
+    int lod = lod_ < 0 ? 0 : lod_;
+    int step = 1 << lod;
+    int nx = sx >> lod;
+    int ny = sy >> lod;
+    int nz = sz >> lod;
+
+    // Cells of the chunk at the current lod, with a one cell border copied from the neighbours. Face culling only reads
+    // from here, instead of going through Map::cell_at for every neighbour of every cell.
+    int px = nx + 2;
+    int py = ny + 2;
+    uint8_t padded[(sx + 2) * (sy + 2) * (sz + 2)] = {};
+    // Light of the same cells, faces take the light of the cell in front of them. Coarser lods are far enough to be lit
+    // by full sky light, which also keeps them from averaging the light of whole blocks.
+    uint8_t padded_light[(sx + 2) * (sy + 2) * (sz + 2)];
+    memset(padded_light, lod == 0 ? 0 : Lighting::max_light << 4, sizeof(padded_light));
+    auto padded_index = [px, py](int x, int y, int z) { return (x + 1) + (y + 1) * px + (z + 1) * px * py; };
+
+    for (int y = -1; y <= ny; y++) {
+        for (int x = -1; x <= nx; x++) {
+            int offset_x = x < 0 ? -1 : (x >= nx ? 1 : 0);
+            int offset_y = y < 0 ? -1 : (y >= ny ? 1 : 0);
+            Chunk* source = this;
+            int local_x = x - offset_x * nx;
+            int local_y = y - offset_y * ny;
+            if (lod == 0) {
+                // Light is kept per cell whatever lod the neighbour is meshed at, so it's copied even for the skirts.
+                // The only faces looking at solid cells or off the map are skirts, they're lit like open sky instead
+                // of by the dark inside of the ground.
+                Chunk* light_source = offset_x != 0 || offset_y != 0 ? Map::chunk_at(chunk_x_ + offset_x, chunk_y_ + offset_y) : this;
+                for (int z = 0; z < nz; z++) {
+                    int index = local_x + local_y * sx + z * sx * sy;
+                    bool open = light_source && Lighting::IsTransparent(light_source->cells[index]);
+                    padded_light[padded_index(x, y, z)] = open ? light_source->light[index] : Lighting::max_light << 4;
+                }
+                padded_light[padded_index(x, y, nz)] = Lighting::max_light << 4;
+            }
+            if (offset_x != 0 || offset_y != 0) {
+                source = Map::chunk_at(chunk_x_ + offset_x, chunk_y_ + offset_y);
+                // Border of the map, or a neighbour meshed at another lod: keep the border empty. The faces facing it
+                // are then emitted and act as a skirt hiding the cracks between the two levels.
+                if (source == nullptr || (source->lod_ >= 0 && source->lod_ != lod)) {
+                    continue;
+                }
+            }
+            for (int z = 0; z < nz; z++) {
+                padded[padded_index(x, y, z)] = source->GetCellLod(local_x, local_y, z, lod);
+            }
         }
     }
 
@@ -57,11 +144,50 @@ void Chunk::UpdateGeometryBuffers(ID3D11Device* device, ID3D11DeviceContext* con
     static vec3_t dirt_col = vec3(115.f / 256, 63.f / 256, 23.f / 256);
     static vec3_t stone_col = vec3(120.f / 256, 120.f / 256, 120.f / 256);
     static vec3_t water_col = vec3(100.f / 256, 110.f / 256, 220.f / 256);
-
-    for (int z = 0; z < Chunk::sz; z++) {
-        for (int y = 0; y < Chunk::sy; y++) {
-            for (int x = 0; x < Chunk::sx; x++) {
-                uint8_t cell_type = GetCellLocal(x, y, z);
+    static vec3_t lamp_col = vec3(1.0f, 0.9f, 0.5f);
+    static vec3_t sand_col = vec3(220.f / 256, 200.f / 256, 140.f / 256);
+    static vec3_t snow_col = vec3(240.f / 256, 245.f / 256, 250.f / 256);
+    static vec3_t wood_col = vec3(110.f / 256, 75.f / 256, 40.f / 256);
+    static vec3_t leaves_col = vec3(40.f / 256, 130.f / 256, 40.f / 256);
+
+    // brightness for each light level: 0.1 + 0.9 * 0.8^(15 - level), a bit of ambient so caves aren't pitch black
+    static const float light_curve[Lighting::max_light + 1] = {
+        0.132f, 0.140f, 0.149f, 0.162f, 0.177f, 0.197f, 0.221f, 0.251f, 0.289f, 0.336f, 0.395f, 0.469f, 0.561f, 0.676f, 0.820f, 1.000f,
+    };
+
+    // Classic voxel ambient occlusion: each corner of a face is darkened by the solid cells among the 3 touching it in
+    // the layer the face looks at, the cell at (fx, fy, fz). corner_signs gives, for each vertex, its side of the face
+    // along u_axis and v_axis (0 = x, 1 = y, 2 = z, chunk cell axes).
+    static const float ao_shade[4] = { 0.5f, 0.7f, 0.85f, 1.0f };
+    static const int corner_signs_a[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+    static const int corner_signs_b[4][2] = { { -1, -1 }, { -1, 1 }, { 1, 1 }, { 1, -1 } };
+    auto push_face = [&](vec3_t a, vec3_t b, vec3_t c, vec3_t d, vec3_t col, int fx, int fy, int fz, int u_axis, int v_axis, const int (&corner_signs)[4][2]) {
+        col = vec3_scale(col, light_curve[Lighting::Brightest(padded_light[padded_index(fx, fy, fz)])]);
+        if (!ambient_occlusion_) {
+            builder_.PushQuad(a, b, c, d, col);
+            return;
+        }
+        float shade[4];
+        for (int i = 0; i < 4; i++) {
+            int u[3] = {};
+            int v[3] = {};
+            u[u_axis] = corner_signs[i][0];
+            v[v_axis] = corner_signs[i][1];
+            int side1 = padded[padded_index(fx + u[0], fy + u[1], fz + u[2])] != 0;
+            int side2 = padded[padded_index(fx + v[0], fy + v[1], fz + v[2])] != 0;
+            int corner = padded[padded_index(fx + u[0] + v[0], fy + u[1] + v[1], fz + u[2] + v[2])] != 0;
+            // both sides solid hide the corner cell, fully occluded either way
+            int ao = side1 && side2 ? 0 : 3 - side1 - side2 - corner;
+            shade[i] = ao_shade[ao];
+        }
+        builder_.PushQuad(a, b, c, d, col, shade);
+    };
+
+    float s = (float) step;
+    for (int z = 0; z < nz; z++) {
+        for (int y = 0; y < ny; y++) {
+            for (int x = 0; x < nx; x++) {
+                uint8_t cell_type = padded[padded_index(x, y, z)];
                 if (cell_type == 0) {
                     continue;
                 }
@@ -73,77 +199,44 @@ void Chunk::UpdateGeometryBuffers(ID3D11Device* device, ID3D11DeviceContext* con
                 case 1: side_col = dirt_col; break;
                 case 2: side_col = stone_col; top_col = stone_col; break;
                 case 3: side_col = water_col; top_col = water_col; break;
+                case 4: side_col = lamp_col; top_col = lamp_col; break;
+                case 5: side_col = sand_col; top_col = sand_col; break;
+                case 6: side_col = snow_col; top_col = snow_col; break;
+                case 7: side_col = wood_col; top_col = wood_col; break;
+                case 8: side_col = leaves_col; top_col = leaves_col; break;
                 }
 
                 // convert chunk cell coords to dx11 coords. Z up -> Y up, chunk local -> world.
 
-                int wx = x + chunk_x_ * Chunk::sx;
-                int wy = z;
-                int wz = y + chunk_y_ * Chunk::sy;
-
-                int cx = x + chunk_x_ * Chunk::sx;
-                int cy = y + chunk_y_ * Chunk::sy;
-                int cz = z;
+                float wx = (float) (x * step + chunk_x_ * Chunk::sx);
+                float wy = (float) (z * step);
+                float wz = (float) (y * step + chunk_y_ * Chunk::sy);
 
                 // x-
-                if (Map::cell_at(cx - 1, cy, cz) == 0) {
-                    builder_.PushQuad(vec3(wx, wy, wz), vec3(wx, wy, wz + 1), vec3(wx, wy + 1, wz + 1), vec3(wx, wy + 1, wz), vec3_scale(side_col, 0.6f));
+                if (padded[padded_index(x - 1, y, z)] == 0) {
+                    push_face(vec3(wx, wy, wz), vec3(wx, wy, wz + s), vec3(wx, wy + s, wz + s), vec3(wx, wy + s, wz), vec3_scale(side_col, 0.6f), x - 1, y, z, 1, 2, corner_signs_a);
                 }
                 // x+
-                if (Map::cell_at(cx + 1, cy, cz) == 0) {
-                    builder_.PushQuad(vec3(wx + 1, wy, wz), vec3(wx + 1, wy + 1, wz), vec3(wx + 1, wy + 1, wz + 1), vec3(wx + 1, wy, wz + 1), vec3_scale(side_col, 0.9f));
+                if (padded[padded_index(x + 1, y, z)] == 0) {
+                    push_face(vec3(wx + s, wy, wz), vec3(wx + s, wy + s, wz), vec3(wx + s, wy + s, wz + s), vec3(wx + s, wy, wz + s), vec3_scale(side_col, 0.9f), x + 1, y, z, 1, 2, corner_signs_b);
                 }
                 // y+
-                if (Map::cell_at(cx, cy + 1, cz) == 0) {
-                    builder_.PushQuad(vec3(wx, wy, wz + 1), vec3(wx + 1, wy, wz + 1), vec3(wx + 1, wy + 1, wz + 1), vec3(wx, wy + 1, wz + 1), side_col);
+                if (padded[padded_index(x, y + 1, z)] == 0) {
+                    push_face(vec3(wx, wy, wz + s), vec3(wx + s, wy, wz + s), vec3(wx + s, wy + s, wz + s), vec3(wx, wy + s, wz + s), side_col, x, y + 1, z, 0, 2, corner_signs_a);
                 }
                 // y-
-                if (Map::cell_at(cx, cy - 1, cz) == 0) {
-                    builder_.PushQuad(vec3(wx, wy, wz), vec3(wx, wy + 1, wz), vec3(wx + 1, wy + 1, wz), vec3(wx + 1, wy, wz), vec3_scale(side_col, 0.5f));
+                if (padded[padded_index(x, y - 1, z)] == 0) {
+                    push_face(vec3(wx, wy, wz), vec3(wx, wy + s, wz), vec3(wx + s, wy + s, wz), vec3(wx + s, wy, wz), vec3_scale(side_col, 0.5f), x, y - 1, z, 0, 2, corner_signs_b);
                 }
                 // z+
-                if (Map::cell_at(cx, cy, cz + 1) == 0) {
-                    builder_.PushQuad(vec3(wx, wy + 1, wz), vec3(wx, wy + 1, wz + 1), vec3(wx + 1, wy + 1, wz + 1), vec3(wx + 1, wy + 1, wz), top_col);
+                if (padded[padded_index(x, y, z + 1)] == 0) {
+                    push_face(vec3(wx, wy + s, wz), vec3(wx, wy + s, wz + s), vec3(wx + s, wy + s, wz + s), vec3(wx + s, wy + s, wz), top_col, x, y, z + 1, 0, 1, corner_signs_b);
                 }
                 // z-
-                if (Map::cell_at(cx, cy, cz - 1) == 0) {
-                    builder_.PushQuad(vec3(wx, wy, wz), vec3(wx + 1, wy, wz), vec3(wx + 1, wy, wz + 1), vec3(wx, wy, wz + 1), side_col);
+                if (padded[padded_index(x, y, z - 1)] == 0) {
+                    push_face(vec3(wx, wy, wz), vec3(wx + s, wy, wz), vec3(wx + s, wy, wz + s), vec3(wx, wy, wz + s), side_col, x, y, z - 1, 0, 1, corner_signs_a);
                 }
             }
         }
     }
-
-    // Update dx11 buffers
-    {
-        // Update vertex buffer
-        {
-            D3D11_MAPPED_SUBRESOURCE mapped_resource = {};
-            context->Map(vbuffer_, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
-            memcpy(mapped_resource.pData, builder_.vert.data(), builder_.vert.size() * sizeof(builder_.vert[0]));
-            context->Unmap(vbuffer_, 0);
-        }
-
-        // Update index buffer
-        {
-            D3D11_MAPPED_SUBRESOURCE mapped_resource = {};
-            context->Map(ibuffer_, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
-            memcpy(mapped_resource.pData, builder_.ind.data(), builder_.ind.size() * sizeof(builder_.ind[0]));
-            context->Unmap(ibuffer_, 0);
-        }
-    }
-}
-
-void Chunk::Render(ID3D11Device* device, ID3D11DeviceContext* context)
-{
-    if (vbuffer_ == nullptr) {
-        UpdateGeometryBuffers(device, context);
-    }
-
-    UINT stride = sizeof(struct Vertex);
-    UINT offset = 0;
-    context->IASetVertexBuffers(0, 1, &vbuffer_, &stride, &offset);
-    context->IASetIndexBuffer(ibuffer_, DXGI_FORMAT_R32_UINT, 0);
-
-    // draw
-    context->DrawIndexed(builder_.ind.size(), 0, 0);
 }
@@ -1,7 +1,6 @@
 #pragma once
 #include "types.h"
 #include "GeometryBuilder.h"
-#include <d3d11.h>
 
 class Chunk
 {
@@ -10,19 +9,33 @@ class Chunk
 	static constexpr int sy = 8;
 	static constexpr int sz = 32;
 
+	// lod n meshes blocks of (1 << n)^3 cells as a single cell. 3 is the coarsest level, a 8x8 chunk becomes a single column.
+	static constexpr int max_lod = 3;
+
+	// darken face corners next to solid cells, see BuildMesh
+	static bool ambient_occlusion_;
+
 	int chunk_x_;
 	int chunk_y_;
-	bool dirty_;
+	bool dirty_ = true;
+	// lod the chunk should be meshed at, -1 when the chunk is not visible.
+	int lod_ = -1;
+	// last Generator::Stage done
+	int stage_ = 0;
 
-	uint8_t cells[sx * sy * sz];
+	uint8_t cells[sx * sy * sz] = {};
+	// same layout as cells, sky light in the high 4 bits and block light in the low 4, see Lighting.h
+	uint8_t light[sx * sy * sz] = {};
 
-	ID3D11Buffer* vbuffer_;
-	ID3D11Buffer* ibuffer_;
+	// cpu side mesh, filled by BuildMesh and handed over to the chunk's RenderRegion
 	GeometryBuilder builder_;
 
 	Chunk(int chunk_x, int chunk_y);
 	void SetCellLocal(int x, int y, int z, uint8_t val);
 	uint8_t GetCellLocal(int x, int y, int z);
-	void UpdateGeometryBuffers(ID3D11Device* device, ID3D11DeviceContext* context);
-	void Render(ID3D11Device* device, ID3D11DeviceContext* context);
+	uint8_t GetCellLod(int x, int y, int z, int lod);
+	void SetLod(int lod);
+	void BuildMesh();
+
+	static int LodForDistance(int chunk_dist_sq);
 };
@@ -0,0 +1,27 @@
+#include "CommandBuffer.h"
+
+void CommandBuffer::Clear()
+{
+    commands_.clear();
+    draw_count_ = 0;
+    chunk_draw_count_ = 0;
+}
+
+void CommandBuffer::SetBuffers(void* vbuffer, void* ibuffer)
+{
+    Command command = {};
+    command.type = Type::SetBuffers;
+    command.vbuffer = vbuffer;
+    command.ibuffer = ibuffer;
+    commands_.push_back(command);
+}
+
+void CommandBuffer::DrawIndexed(uint32_t index_count, uint32_t first_index)
+{
+    Command command = {};
+    command.type = Type::DrawIndexed;
+    command.index_count = index_count;
+    command.first_index = first_index;
+    commands_.push_back(command);
+    draw_count_++;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+struct ID3D11DeviceContext;
+
+// Draw commands recorded without touching D3D, so every worker thread can fill its own buffer. Executed in recording
+// order on a device context, the immediate one or a deferred one, see CommandBufferD3D11.cpp.
+class CommandBuffer
+{
+	public:
+	enum class Type { SetBuffers, DrawIndexed };
+
+	struct Command
+	{
+		Type type;
+		// SetBuffers, opaque here: ID3D11Buffer* when executed
+		void* vbuffer;
+		void* ibuffer;
+		// DrawIndexed
+		uint32_t index_count;
+		uint32_t first_index;
+	};
+
+	std::vector<Command> commands_;
+	int draw_count_ = 0;
+	// draws one per chunk would have needed, see RenderRegion::Record
+	int chunk_draw_count_ = 0;
+
+	void Clear();
+	// vertex buffer of Vertex and 32 bit index buffer
+	void SetBuffers(void* vbuffer, void* ibuffer);
+	void DrawIndexed(uint32_t index_count, uint32_t first_index);
+	// Expects the pipeline state (shaders, layout, render target...) to be set on context. Windows only.
+	void Execute(ID3D11DeviceContext* context) const;
+};
@@ -0,0 +1,23 @@
+#include "CommandBuffer.h"
+#include <d3d11.h>
+#include "types.h"
+
+void CommandBuffer::Execute(ID3D11DeviceContext* context) const
+{
+    UINT stride = sizeof(struct Vertex);
+    UINT offset = 0;
+    for (const Command& command : commands_) {
+        switch (command.type) {
+            case Type::SetBuffers: {
+                ID3D11Buffer* vbuffer = (ID3D11Buffer*) command.vbuffer;
+                context->IASetVertexBuffers(0, 1, &vbuffer, &stride, &offset);
+                context->IASetIndexBuffer((ID3D11Buffer*) command.ibuffer, DXGI_FORMAT_R32_UINT, 0);
+                break;
+            }
+            case Type::DrawIndexed: {
+                context->DrawIndexed(command.index_count, command.first_index, 0);
+                break;
+            }
+        }
+    }
+}
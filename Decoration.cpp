@@ -0,0 +1,185 @@
+#include "Decoration.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "Chunk.h"
+#include "Map.h"
+#include "Random.h"
+#include "Instrument.h"
+
+namespace Decoration
+{
+    std::atomic<int> structure_count_ = 0;
+    std::atomic<int> queued_write_count_ = 0;
+
+    static constexpr uint8_t stone = 2;
+    static constexpr uint8_t wood = 7;
+    static constexpr uint8_t leaves = 8;
+
+    struct PendingWrite
+    {
+        int source; // index of the chunk the structure is rooted in
+        int index; // in the target chunk's cells
+        uint8_t cell;
+    };
+
+    static std::mutex mutex_;
+    // by index of the chunk the writes go to
+    static std::unordered_map<int, std::vector<PendingWrite>> pending_;
+
+    // Structures only fill open cells, a trunk can also replace leaves. The same set of writes gives the same cells in
+    // any order, except two structures filling the same open cell, which ApplyPending orders.
+    static bool CanWrite(uint8_t existing, uint8_t cell)
+    {
+        return existing == 0 || (existing == leaves && cell == wood);
+    }
+
+    // collects the cells of the structures of one chunk
+    struct Writer
+    {
+        Chunk* chunk;
+        int chunk_index;
+        std::vector<std::pair<int, PendingWrite>> queued; // target chunk index, write
+
+        void Set(int x, int y, int z, uint8_t cell)
+        {
+            if (z < 0 || z >= Chunk::sz) {
+                return;
+            }
+            // x and y are local to chunk, and can be a few cells out of it
+            int chunk_x = chunk->chunk_x_ + (x < 0 ? -1 : x / Chunk::sx);
+            int chunk_y = chunk->chunk_y_ + (y < 0 ? -1 : y / Chunk::sy);
+            Chunk* target = Map::chunk_at(chunk_x, chunk_y);
+            if (target == nullptr) {
+                return;
+            }
+            int local_x = (x + Chunk::sx) % Chunk::sx;
+            int local_y = (y + Chunk::sy) % Chunk::sy;
+            int index = local_x + local_y * Chunk::sx + z * Chunk::sx * Chunk::sy;
+            if (target == chunk) {
+                if (CanWrite(chunk->cells[index], cell)) {
+                    chunk->cells[index] = cell;
+                }
+                return;
+            }
+            queued.push_back({ chunk_x + chunk_y * Map::max_chunks_x, { chunk_index, index, cell } });
+        }
+    };
+
+    static void Tree(Writer* writer, Random* random, int x, int y, int z)
+    {
+        int height = 4 + (int) (random->Next() % 2);
+        for (int dz = height - 2; dz <= height + 1; dz++) {
+            int radius = dz < height ? 2 : 1;
+            for (int dy = -radius; dy <= radius; dy++) {
+                for (int dx = -radius; dx <= radius; dx++) {
+                    // round the canopy a bit
+                    if (radius == 2 && abs(dx) == 2 && abs(dy) == 2) {
+                        continue;
+                    }
+                    writer->Set(x + dx, y + dy, z + dz, leaves);
+                }
+            }
+        }
+        for (int dz = 0; dz < height; dz++) {
+            writer->Set(x, y, z + dz, wood);
+        }
+    }
+
+    static void Rock(Writer* writer, Random* random, int x, int y, int z)
+    {
+        int radius = 1 + (int) (random->Next() % 2);
+        for (int dz = -radius; dz <= radius; dz++) {
+            for (int dy = -radius; dy <= radius; dy++) {
+                for (int dx = -radius; dx <= radius; dx++) {
+                    if (dx * dx + dy * dy + dz * dz <= radius * radius + 1) {
+                        writer->Set(x + dx, y + dy, z + dz, stone);
+                    }
+                }
+            }
+        }
+    }
+
+    void Decorate(Chunk* chunk)
+    {
+        INSTRUMENT_ZONE("Decoration::Decorate");
+        // every chunk gets its own stream, the structures don't depend on the order chunks are decorated in
+        Random random(((uint32_t) chunk->chunk_x_ * 73856093u) ^ ((uint32_t) chunk->chunk_y_ * 19349663u) ^ 0x5eed);
+        Writer writer = {
+            .chunk = chunk,
+            .chunk_index = chunk->chunk_x_ + chunk->chunk_y_ * Map::max_chunks_x,
+            .queued = {},
+        };
+
+        constexpr int attempts = 3;
+        for (int attempt = 0; attempt < attempts; attempt++) {
+            int x = (int) (random.Next() % Chunk::sx);
+            int y = (int) (random.Next() % Chunk::sy);
+            float roll = random.NextFloat();
+
+            int z = Chunk::sz - 1;
+            while (z > 0 && chunk->GetCellLocal(x, y, z) == 0) {
+                z--;
+            }
+            uint8_t surface = chunk->GetCellLocal(x, y, z);
+            if (surface == 1 && roll < 0.35f && z + 7 < Chunk::sz) {
+                Tree(&writer, &random, x, y, z + 1);
+                structure_count_++;
+            } else if ((surface == 5 || surface == 6 || surface == stone) && roll < 0.15f) {
+                Rock(&writer, &random, x, y, z + 1);
+                structure_count_++;
+            }
+        }
+
+        if (writer.queued.empty()) {
+            return;
+        }
+        queued_write_count_ += (int) writer.queued.size();
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& [target, write] : writer.queued) {
+            pending_[target].push_back(write);
+        }
+    }
+
+    void ApplyPending(Chunk* chunk)
+    {
+        std::vector<PendingWrite> writes;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = pending_.find(chunk->chunk_x_ + chunk->chunk_y_ * Map::max_chunks_x);
+            if (it == pending_.end()) {
+                return;
+            }
+            writes.swap(it->second);
+            pending_.erase(it);
+        }
+
+        // each source queues its writes at once and in order, sorting by source is enough
+        std::stable_sort(writes.begin(), writes.end(), [](const PendingWrite& a, const PendingWrite& b) { return a.source < b.source; });
+        for (const PendingWrite& write : writes) {
+            if (CanWrite(chunk->cells[write.index], write.cell)) {
+                chunk->cells[write.index] = write.cell;
+            }
+        }
+        chunk->dirty_ = true;
+    }
+
+    int PendingCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int count = 0;
+        for (auto& entry : pending_) {
+            count += (int) entry.second.size();
+        }
+        return count;
+    }
+
+    void ClearPending()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.clear();
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <atomic>
+
+class Chunk;
+
+// Structures placed on the generated terrain: trees on grass, rocks on sand, snow and stone. A structure can reach
+// into the neighbour chunks. Its cells in the chunk being decorated are written directly, the others are queued for
+// their chunk, which applies them once it's generated, so no neighbour has to be generated early.
+namespace Decoration
+{
+    // Places the structures rooted in chunk, its terrain must be filled. Thread safe, chunks can be decorated in parallel.
+    void Decorate(Chunk* chunk);
+    // Writes the cells the neighbours queued for chunk. They are applied in the order of the chunks that queued them,
+    // so the result doesn't depend on which thread decorated first. Thread safe with Decorate of other chunks, writes
+    // queued after the call wait for the next one.
+    void ApplyPending(Chunk* chunk);
+    // writes queued and not applied yet, for any chunk
+    int PendingCount();
+    // drops the queued writes, for when the chunks are generated again from scratch
+    void ClearPending();
+
+    extern std::atomic<int> structure_count_;
+    extern std::atomic<int> queued_write_count_;
+}
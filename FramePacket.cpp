@@ -0,0 +1,47 @@
+#include "FramePacket.h"
+
+FramePacket* FrameQueue::BeginWrite()
+{
+    // write_ is never read by the render thread, no need to lock
+    return &packets_[write_];
+}
+
+bool FrameQueue::EndWrite(int timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    int next = 1 - write_;
+    if (!cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] { return quit_ || (pending_ == -1 && reading_ != next); })) {
+        return false;
+    }
+    pending_ = write_;
+    write_ = next;
+    cond_.notify_all();
+    return true;
+}
+
+FramePacket* FrameQueue::BeginRead()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [&] { return quit_ || pending_ != -1; });
+    if (pending_ == -1) {
+        return nullptr;
+    }
+    reading_ = pending_;
+    pending_ = -1;
+    cond_.notify_all();
+    return &packets_[reading_];
+}
+
+void FrameQueue::EndRead()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    reading_ = -1;
+    cond_.notify_all();
+}
+
+void FrameQueue::Quit()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+    cond_.notify_all();
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "GeometryBuilder.h"
+#include "ParticleSystem.h"
+#include "Game.h"
+
+// Everything the render thread needs to draw a frame, filled on the game thread by Game::FillPacket. The packet owns
+// its data so the game thread can run the next ticks while it is drawn.
+struct FramePacket
+{
+	struct MeshUpload
+	{
+		int chunk_x;
+		int chunk_y;
+		GeometryBuilder mesh;
+	};
+
+	int frame_index;
+	// client area of the window, the render thread resizes the swap chain when it changes
+	int width;
+	int height;
+	Game::Camera camera;
+	uint32_t visible_masks[Game::regions_x * Game::regions_y];
+	// chunks remeshed since the previous packet, for their RenderRegion
+	std::vector<MeshUpload> mesh_uploads;
+	// one array per particle system, in ParticleManager::systems_ order
+	std::vector<std::vector<ParticleInstance>> particle_instances;
+	bool profiler_overlay;
+};
+
+// Two packets: the game thread fills one while the render thread draws the other. The game thread is at most one frame
+// ahead, EndWrite waits until the render thread is done with the packet that will be written next. The wait is bounded
+// so the window thread can keep handling its messages meanwhile, see the main loop.
+class FrameQueue
+{
+	FramePacket packets_[2];
+	int write_ = 0;
+	// published and not picked up yet, -1 if none
+	int pending_ = -1;
+	// being drawn, -1 if none
+	int reading_ = -1;
+	bool quit_ = false;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+
+	public:
+	FramePacket* BeginWrite();
+	/// Publishes the packet. Returns false if the render thread still wasn't done with the next one after timeout_ms,
+	/// the packet isn't published then and EndWrite must be called again.
+	bool EndWrite(int timeout_ms);
+	/// Blocks until a packet is published. Returns null after Quit, once the last published packet has been read.
+	FramePacket* BeginRead();
+	void EndRead();
+	void Quit();
+};
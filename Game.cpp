@@ -0,0 +1,196 @@
+#include "Game.h"
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include "Chunk.h"
+#include "Profiler.h"
+#include "FramePacket.h"
+
+namespace Game
+{
+    Camera camera = { {0, 0, -2}, 0.f, 0.f };
+    Camera previous_camera = { {0, 0, -2}, 0.f, 0.f };
+    int tick_count = 0;
+    uint32_t visible_masks[regions_x * regions_y];
+    ParticleManager particles;
+    CharacterController player;
+
+    static ParticleSystem* particle_system;
+    static ParticleSystem* particle_system2;
+
+    static float accumulator_ = 0;
+    // input waiting for the next tick
+    static Input::State pending_input_;
+    // meshes waiting for the next FillPacket
+    static std::vector<FramePacket::MeshUpload> mesh_uploads_;
+
+    void Init()
+    {
+        particle_system = particles.Add(new ParticleSystem(100));
+        particle_system2 = particles.Add(new ParticleSystem(6000, 1337));
+        particle_system2->pos_ = vec3(3, 19, 0);
+        particle_system2->target_velocity_ = vec3(0, -1, 0);
+        particle_system2->spawn_volume_size_ = vec3(40, 0, 40);
+        particle_system2->lifetime_ = 12.0f;
+        particle_system2->spawn_rate_ = 0.01f;
+        particle_system2->collision_ = ParticleSystem::Collision::Kill;
+
+        float spawn_x = Map::max_chunks_x * Chunk::sx * 0.5f + 0.5f;
+        float spawn_y = Map::max_chunks_y * Chunk::sy * 0.5f + 0.5f;
+        Map::RayHit ground = Map::Raycast(vec3(spawn_x, spawn_y, (float) Chunk::sz), vec3(0, 0, -1), (float) Chunk::sz);
+        player.pos_ = vec3(spawn_x, ground.hit ? ground.z + 1.0f : (float) Chunk::sz, spawn_y);
+        camera.pos = player.EyePosition();
+        previous_camera = camera;
+    }
+
+    static void MoveCamera(const Input::State& input, float delta_time)
+    {
+        camera.rot_h += input.mouse_delta_x * 0.01f;
+        camera.rot_v += input.mouse_delta_y * 0.01f;
+
+        float rot_h = camera.rot_h;
+        // units per second
+        float speed = input.fly ? 12.0f : 6.0f;
+        vec3_t velocity = {};
+        if (input.w) {
+            velocity.z += speed * cosf(rot_h);
+            velocity.x += speed * sinf(rot_h);
+        }
+        if (input.s) {
+            velocity.z -= speed * cosf(rot_h);
+            velocity.x -= speed * sinf(rot_h);
+        }
+        if (input.d) {
+            velocity.x += speed * cosf(rot_h);
+            velocity.z -= speed * sinf(rot_h);
+        }
+        if (input.a) {
+            velocity.x -= speed * cosf(rot_h);
+            velocity.z += speed * sinf(rot_h);
+        }
+
+        if (!input.fly) {
+            player.Move(velocity, input.jump, delta_time);
+            camera.pos = player.EyePosition();
+            return;
+        }
+
+        if (input.e) {
+            velocity.y += speed;
+        }
+        if (input.q) {
+            velocity.y -= speed;
+        }
+        camera.pos = camera.pos + vec3_scale(velocity, delta_time);
+        // landing where the camera is when flying stops
+        player.pos_ = vec3(camera.pos.x, camera.pos.y - player.eye_height_, camera.pos.z);
+        player.velocity_ = {};
+    }
+
+    float Update(const Input::State& input, float frame_delta)
+    {
+        // held keys are the latest state, mouse movement and key presses add up until a tick uses them so a frame
+        // without tick doesn't lose them
+        float mouse_delta_x = pending_input_.mouse_delta_x + input.mouse_delta_x;
+        float mouse_delta_y = pending_input_.mouse_delta_y + input.mouse_delta_y;
+        bool jump = pending_input_.jump || input.jump;
+        pending_input_ = input;
+        pending_input_.mouse_delta_x = mouse_delta_x;
+        pending_input_.mouse_delta_y = mouse_delta_y;
+        pending_input_.jump = jump;
+
+        accumulator_ += frame_delta < max_frame_delta ? frame_delta : max_frame_delta;
+        while (accumulator_ >= fixed_delta) {
+            accumulator_ -= fixed_delta;
+            Tick(pending_input_, fixed_delta);
+            pending_input_.mouse_delta_x = 0;
+            pending_input_.mouse_delta_y = 0;
+            pending_input_.jump = false;
+        }
+        return accumulator_ / fixed_delta;
+    }
+
+    Camera InterpolatedCamera(float alpha)
+    {
+        Camera result;
+        result.pos.x = previous_camera.pos.x + (camera.pos.x - previous_camera.pos.x) * alpha;
+        result.pos.y = previous_camera.pos.y + (camera.pos.y - previous_camera.pos.y) * alpha;
+        result.pos.z = previous_camera.pos.z + (camera.pos.z - previous_camera.pos.z) * alpha;
+        result.rot_h = previous_camera.rot_h + (camera.rot_h - previous_camera.rot_h) * alpha;
+        result.rot_v = previous_camera.rot_v + (camera.rot_v - previous_camera.rot_v) * alpha;
+        return result;
+    }
+
+    void FillPacket(FramePacket* packet, float alpha)
+    {
+        packet->camera = InterpolatedCamera(alpha);
+        memcpy(packet->visible_masks, visible_masks, sizeof(visible_masks));
+
+        // the render thread has applied the previous uploads of this packet, drop them
+        packet->mesh_uploads.clear();
+        packet->mesh_uploads.swap(mesh_uploads_);
+
+        particles.FillInstances(alpha);
+        packet->particle_instances.resize(particles.systems_.size());
+        for (size_t i = 0; i < particles.systems_.size(); i++) {
+            packet->particle_instances[i] = particles.systems_[i]->instances_;
+        }
+    }
+
+    void Tick(const Input::State& input, float delta_time)
+    {
+        tick_count++;
+
+        if (input.jump) {
+            particle_system->Burst(1);
+        }
+
+        previous_camera = camera;
+        MoveCamera(input, delta_time);
+
+        int player_chunk_x = floorl(camera.pos.x / Chunk::sx);
+        int player_chunk_y = floorl(camera.pos.z / Chunk::sy);
+
+        // pick the lods first, a lod change dirties the neighbours and they must know about it before being meshed
+        for (int chunk_y = 0; chunk_y < Map::max_chunks_y; chunk_y++) {
+            for (int chunk_x = 0; chunk_x < Map::max_chunks_x; chunk_x++) {
+                int dx = abs(player_chunk_x - chunk_x);
+                int dy = abs(player_chunk_y - chunk_y);
+                int dist_sq = (dx * dx) + (dy * dy);
+                Chunk* chunk = Map::chunks[chunk_x + chunk_y * Map::max_chunks_x];
+                chunk->SetLod(dist_sq > view_radius * view_radius ? -1 : Chunk::LodForDistance(dist_sq));
+            }
+        }
+
+        // remesh the visible dirty chunks and gather which chunks of each region are visible
+        Profiler::BeginZone(Profiler::zone_remesh);
+        memset(visible_masks, 0, sizeof(visible_masks));
+        for (int chunk_y = 0; chunk_y < Map::max_chunks_y; chunk_y++) {
+            for (int chunk_x = 0; chunk_x < Map::max_chunks_x; chunk_x++) {
+                Chunk* chunk = Map::chunks[chunk_x + chunk_y * Map::max_chunks_x];
+                if (chunk->lod_ < 0) {
+                    continue;
+                }
+                int region_index = chunk_x / RenderRegion::chunks_x + (chunk_y / RenderRegion::chunks_y) * regions_x;
+                if (chunk->dirty_) {
+                    chunk->BuildMesh();
+                    FramePacket::MeshUpload& upload = mesh_uploads_.emplace_back();
+                    upload.chunk_x = chunk_x;
+                    upload.chunk_y = chunk_y;
+                    upload.mesh.vert.swap(chunk->builder_.vert);
+                    upload.mesh.ind.swap(chunk->builder_.ind);
+                }
+                visible_masks[region_index] |= 1u << RenderRegion::SlotOf(chunk_x, chunk_y);
+            }
+        }
+        Profiler::EndZone(Profiler::zone_remesh);
+
+        // the rain follows the camera
+        particle_system2->pos_.x = camera.pos.x;
+        particle_system2->pos_.z = camera.pos.z;
+
+        Profiler::BeginZone(Profiler::zone_particle_simulate);
+        particles.Simulate(delta_time);
+        Profiler::EndZone(Profiler::zone_particle_simulate);
+    }
+}
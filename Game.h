@@ -0,0 +1,54 @@
+#pragma once
+#include "types.h"
+#include "Input.h"
+#include "Map.h"
+#include "RenderRegion.h"
+#include "ParticleManager.h"
+#include "CharacterController.h"
+
+struct FramePacket;
+
+// Everything a frame does before drawing: camera, chunk lods, remeshing and particles. Shared by the window and the
+// headless replay, so both run exactly the same code for a given input. Touches no D3D object, what the renderer needs
+// is copied to a FramePacket.
+namespace Game
+{
+	constexpr int regions_x = Map::max_chunks_x / RenderRegion::chunks_x;
+	constexpr int regions_y = Map::max_chunks_y / RenderRegion::chunks_y;
+	// distant chunks are meshed at a coarser lod, see Chunk::LodForDistance
+	constexpr int view_radius = 32;
+
+	// the simulation always advances by fixed_delta, whatever the frame rate
+	constexpr float tick_rate = 60.0f;
+	constexpr float fixed_delta = 1.0f / tick_rate;
+	// longer frames (breakpoint, window drag) slow the simulation down instead of running many ticks to catch up
+	constexpr float max_frame_delta = 0.25f;
+
+	struct Camera
+	{
+		vec3_t pos;
+		float rot_h;
+		float rot_v;
+	};
+
+	// camera after the last tick, and before it to interpolate
+	extern Camera camera;
+	extern Camera previous_camera;
+	// ticks since Init, the simulated time is tick_count * fixed_delta
+	extern int tick_count;
+	// chunks of each region visible this frame, one bit per RenderRegion::SlotOf
+	extern uint32_t visible_masks[regions_x * regions_y];
+	extern ParticleManager particles;
+	// walks the camera around, unless the input asks to fly
+	extern CharacterController player;
+
+	/// Creates the particle systems and puts the player on the ground in the middle of the map. The map must be generated.
+	void Init();
+	/// Runs as many fixed ticks as the frame time allows. Returns how far between the last two ticks the frame is, for InterpolatedCamera and FillPacket.
+	float Update(const Input::State& input, float frame_delta);
+	void Tick(const Input::State& input, float delta_time);
+	Camera InterpolatedCamera(float alpha);
+	/// Moves the meshes built since the last call, and copies the camera, visible chunks and particles to packet. The
+	/// camera and particles are interpolated alpha of the way between the last two ticks.
+	void FillPacket(FramePacket* packet, float alpha);
+}
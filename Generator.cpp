@@ -0,0 +1,373 @@
+#include "Generator.h"
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+#include "Chunk.h"
+#include "Map.h"
+#include "Noise.h"
+#include "NoiseCache.h"
+#include "Biome.h"
+#include "Decoration.h"
+#include "Lighting.h"
+#include "JobPool.h"
+#include "Timer.h"
+#include "Instrument.h"
+
+namespace Generator
+{
+    const char* stage_names[stage_count] = {
+        "none",
+        "climate",
+        "heightmap",
+        "fill",
+        "surface",
+        "decoration",
+        "settle",
+        "lighting",
+    };
+
+    bool density_terrain = true;
+    bool use_noise_cache = true;
+    StageStats stage_stats_[stage_count];
+
+    // The neighbours up to radius chunks away must have reached needs before a chunk runs the stage. Structures
+    // reach 2 cells out, so settling waits for the direct neighbours to be decorated. Light spreads at most 14 cells,
+    // 2 chunks, and the cells it goes through must be final.
+    struct StageDependency
+    {
+        int radius;
+        Stage needs;
+    };
+    static const StageDependency dependencies[stage_count] = {
+        { 0, stage_none },
+        { 0, stage_none },
+        { 0, stage_none },
+        { 0, stage_none },
+        { 0, stage_none },
+        { 0, stage_none },
+        { 1, stage_decoration },
+        { 2, stage_settle },
+    };
+
+    // What the early stages leave for the next ones, freed once the materials are in the cells.
+    struct ChunkData
+    {
+        // columns 0 to sx and 0 to sy, the last ones are the first of the next chunk and used by the density grid
+        float weights[Chunk::sy + 1][Chunk::sx + 1][Biome::type_count];
+        float surface[Chunk::sy + 1][Chunk::sx + 1];
+    };
+    static ChunkData* chunk_data_[Map::max_chunks_x * Map::max_chunks_y];
+
+    static int ChunkIndex(Chunk* chunk)
+    {
+        return chunk->chunk_x_ + chunk->chunk_y_ * Map::max_chunks_x;
+    }
+
+    // the two noise layers of the heightmap
+    static constexpr float height_freq = 0.03f;
+    static constexpr int height_depth = 3;
+    static constexpr float detail_freq = 0.11f;
+    static constexpr int detail_depth = 1;
+
+    // ground height of the heightmap at a map column from its noise layers, the height curves of the biomes blended
+    // by their weights
+    static float SurfaceHeight(float height_noise, float detail_noise, const float weights[Biome::type_count])
+    {
+        float perlin = height_noise * Chunk::sz;
+        perlin -= 10;
+        float base = 0;
+        float scale = 0;
+        for (int i = 0; i < Biome::type_count; i++) {
+            base += weights[i] * Biome::params[i].height_base;
+            scale += weights[i] * Biome::params[i].height_scale;
+        }
+        return base + perlin * scale + detail_noise * 4;
+    }
+
+    static void Climate(Chunk* chunk, ChunkData* data)
+    {
+        const Biome::Region* climate = Biome::RegionAt(chunk->chunk_x_ * Chunk::sx, chunk->chunk_y_ * Chunk::sy);
+        for (int y = 0; y <= Chunk::sy; y++) {
+            for (int x = 0; x <= Chunk::sx; x++) {
+                Biome::Weights(climate->At(chunk->chunk_x_ * Chunk::sx + x, chunk->chunk_y_ * Chunk::sy + y), data->weights[y][x]);
+            }
+        }
+    }
+
+    static void Heightmap(Chunk* chunk, ChunkData* data)
+    {
+        // the density only samples the heights on its grid, which ends on the first column of the next chunk
+        int step = density_terrain ? density_step : 1;
+        int last_x = density_terrain ? Chunk::sx : Chunk::sx - 1;
+        int last_y = density_terrain ? Chunk::sy : Chunk::sy - 1;
+        int start_x = chunk->chunk_x_ * Chunk::sx;
+        int start_y = chunk->chunk_y_ * Chunk::sy;
+        if (!use_noise_cache) {
+            for (int y = 0; y <= last_y; y += step) {
+                for (int x = 0; x <= last_x; x += step) {
+                    float height_noise = Noise::perlin2d(start_x + x, start_y + y, height_freq, height_depth);
+                    float detail_noise = Noise::perlin2d(start_x + x, start_y + y, detail_freq, detail_depth);
+                    data->surface[y][x] = SurfaceHeight(height_noise, detail_noise, data->weights[y][x]);
+                }
+            }
+            return;
+        }
+
+        // the chunk is in a single tile, the columns on the next chunk included
+        std::shared_ptr<const NoiseCache::Tile> height_tile = NoiseCache::TileAt(start_x, start_y, step, height_freq, height_depth);
+        std::shared_ptr<const NoiseCache::Tile> detail_tile = NoiseCache::TileAt(start_x, start_y, step, detail_freq, detail_depth);
+        for (int y = 0; y <= last_y; y += step) {
+            for (int x = 0; x <= last_x; x += step) {
+                float height_noise = height_tile->At(start_x + x, start_y + y);
+                float detail_noise = detail_tile->At(start_x + x, start_y + y);
+                data->surface[y][x] = SurfaceHeight(height_noise, detail_noise, data->weights[y][x]);
+            }
+        }
+    }
+
+    static void FillHeightmap(Chunk* chunk, ChunkData* data)
+    {
+        for (int y = 0; y < Chunk::sy; y++) {
+            for (int x = 0; x < Chunk::sx; x++) {
+                for (int z = 0; z < Chunk::sz; z++) {
+                    chunk->SetCellLocal(x, y, z, z <= data->surface[y][x] ? 2 : 0);
+                }
+            }
+        }
+    }
+
+    static void FillDensity(Chunk* chunk, ChunkData* data)
+    {
+        // Density is positive inside the ground: the distance to the heightmap surface, moved by 3d noise for the
+        // overhangs, and cut by a thin band of another 3d noise for the caves. The noise is only sampled on a coarse
+        // grid, cells interpolate the 8 grid points around them.
+        constexpr int grid_x = Chunk::sx / density_step + 1;
+        constexpr int grid_y = Chunk::sy / density_step + 1;
+        constexpr int grid_z = Chunk::sz / density_step + 1;
+        float grid[grid_z][grid_y][grid_x];
+        for (int gy = 0; gy < grid_y; gy++) {
+            for (int gx = 0; gx < grid_x; gx++) {
+                int x = chunk->chunk_x_ * Chunk::sx + gx * density_step;
+                int y = chunk->chunk_y_ * Chunk::sy + gy * density_step;
+                float surface = data->surface[gy * density_step][gx * density_step];
+                for (int gz = 0; gz < grid_z; gz++) {
+                    int z = gz * density_step;
+                    // Both noises are added at every grid point, even far from the surface or in the air. The cells
+                    // interpolate between grid points, skipping the noise at some of them would make the density jump
+                    // there and move the surface between them.
+                    float density = surface - z;
+                    density += (Noise::perlin3d(x, y, z, 0.05f, 2) - 0.5f) * 16;
+                    float cave = (fabsf(Noise::perlin3d(x + 1000, y, z, 0.06f, 2) - 0.5f) - 0.06f) * 80;
+                    density = density < cave ? density : cave;
+                    grid[gz][gy][gx] = density;
+                }
+            }
+        }
+
+        for (int y = 0; y < Chunk::sy; y++) {
+            for (int x = 0; x < Chunk::sx; x++) {
+                int gx = x / density_step;
+                int gy = y / density_step;
+                float fx = (float) (x % density_step) / density_step;
+                float fy = (float) (y % density_step) / density_step;
+                for (int z = 0; z < Chunk::sz; z++) {
+                    int gz = z / density_step;
+                    float fz = (float) (z % density_step) / density_step;
+                    float low_low = Noise::lin_inter(grid[gz][gy][gx], grid[gz][gy][gx + 1], fx);
+                    float low_high = Noise::lin_inter(grid[gz][gy + 1][gx], grid[gz][gy + 1][gx + 1], fx);
+                    float high_low = Noise::lin_inter(grid[gz + 1][gy][gx], grid[gz + 1][gy][gx + 1], fx);
+                    float high_high = Noise::lin_inter(grid[gz + 1][gy + 1][gx], grid[gz + 1][gy + 1][gx + 1], fx);
+                    float density = Noise::lin_inter(Noise::lin_inter(low_low, low_high, fy), Noise::lin_inter(high_low, high_high, fy), fz);
+                    // keep a floor under the caves
+                    chunk->SetCellLocal(x, y, z, density > 0 || z == 0 ? 2 : 0);
+                }
+            }
+        }
+    }
+
+    // Materials of each column from which of its cells the fill made solid: the biome's surface on top of the
+    // ground, its subsurface and stone under it, water in the open cells up to the sea level.
+    static void Surface(Chunk* chunk, ChunkData* data)
+    {
+        for (int y = 0; y < Chunk::sy; y++) {
+            for (int x = 0; x < Chunk::sx; x++) {
+                const Biome::Params& params = Biome::params[Biome::Dominant(data->weights[y][x])];
+                int depth = 0;
+                for (int z = Chunk::sz - 1; z >= 0; z--) {
+                    uint8_t cell = 0;
+                    if (chunk->GetCellLocal(x, y, z) != 0) {
+                        if (depth == 0) {
+                            cell = z > params.snow_line ? 6 : params.surface;
+                        } else {
+                            cell = depth <= params.subsurface_depth ? params.subsurface : 2;
+                        }
+                        depth++;
+                    } else {
+                        depth = 0;
+                        if (z <= 5) {
+                            cell = 3;
+                        }
+                    }
+                    chunk->SetCellLocal(x, y, z, cell);
+                }
+            }
+        }
+    }
+
+    static void RunStage(Chunk* chunk, Stage stage)
+    {
+        ChunkData*& data = chunk_data_[ChunkIndex(chunk)];
+        switch (stage) {
+        case stage_climate:
+            assert(data == nullptr);
+            data = new ChunkData();
+            Climate(chunk, data);
+            break;
+        case stage_heightmap:
+            Heightmap(chunk, data);
+            break;
+        case stage_fill:
+            if (density_terrain) {
+                FillDensity(chunk, data);
+            } else {
+                FillHeightmap(chunk, data);
+            }
+            break;
+        case stage_surface:
+            Surface(chunk, data);
+            delete data;
+            data = nullptr;
+            break;
+        case stage_decoration:
+            Decoration::Decorate(chunk);
+            break;
+        case stage_settle:
+            Decoration::ApplyPending(chunk);
+            break;
+        case stage_lighting:
+            Lighting::LightChunk(chunk);
+            break;
+        default:
+            break;
+        }
+        chunk->stage_ = stage;
+    }
+
+    static bool Ready(Chunk* chunk, Stage stage)
+    {
+        if (chunk->stage_ != stage - 1) {
+            return false;
+        }
+        int radius = dependencies[stage].radius;
+        for (int dy = -radius; dy <= radius; dy++) {
+            for (int dx = -radius; dx <= radius; dx++) {
+                Chunk* neighbour = Map::chunk_at(chunk->chunk_x_ + dx, chunk->chunk_y_ + dy);
+                if (neighbour && neighbour->stage_ < dependencies[stage].needs) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void Generate(const std::vector<Chunk*>& chunks, Stage target)
+    {
+        INSTRUMENT_ZONE("Generator::Generate");
+        constexpr int chunk_count = Map::max_chunks_x * Map::max_chunks_y;
+
+        // stage each chunk has to reach, from the top stage down: a chunk needing a stage asks its neighbours for
+        // the stage's dependency, which is lower and handled by a later iteration
+        int needed[chunk_count] = {};
+        for (Chunk* chunk : chunks) {
+            needed[ChunkIndex(chunk)] = target;
+        }
+        for (int stage = target; stage > stage_none; stage--) {
+            int radius = dependencies[stage].radius;
+            if (radius == 0) {
+                continue;
+            }
+            for (int i = 0; i < chunk_count; i++) {
+                if (needed[i] < stage) {
+                    continue;
+                }
+                Chunk* chunk = Map::chunks[i];
+                for (int dy = -radius; dy <= radius; dy++) {
+                    for (int dx = -radius; dx <= radius; dx++) {
+                        Chunk* neighbour = Map::chunk_at(chunk->chunk_x_ + dx, chunk->chunk_y_ + dy);
+                        if (neighbour && needed[ChunkIndex(neighbour)] < dependencies[stage].needs) {
+                            needed[ChunkIndex(neighbour)] = dependencies[stage].needs;
+                        }
+                    }
+                }
+            }
+        }
+
+        std::vector<Chunk*> batch;
+        for (int stage = stage_none + 1; stage <= target; stage++) {
+            batch.clear();
+            for (int i = 0; i < chunk_count; i++) {
+                if (needed[i] >= stage && Map::chunks[i]->stage_ < stage) {
+                    batch.push_back(Map::chunks[i]);
+                }
+            }
+            if (batch.empty()) {
+                continue;
+            }
+
+            auto start = Timer::Now();
+            auto run = [&](int begin, int end) {
+                auto batch_start = Timer::Now();
+                for (int i = begin; i < end; i++) {
+                    assert(Ready(batch[i], (Stage) stage));
+                    RunStage(batch[i], (Stage) stage);
+                }
+                stage_stats_[stage].ticks += Timer::Now() - batch_start;
+            };
+            // the lighting spreads into the neighbours and shares the Lighting queues, one chunk at a time
+            if (stage == stage_lighting) {
+                run(0, (int) batch.size());
+            } else {
+                JobPool::ParallelFor((int) batch.size(), 16, run);
+            }
+            stage_stats_[stage].chunks += (int) batch.size();
+            stage_stats_[stage].wall_seconds += Timer::SecondsSince(start);
+        }
+    }
+
+    void Reset()
+    {
+        for (int i = 0; i < Map::max_chunks_x * Map::max_chunks_y; i++) {
+            delete chunk_data_[i];
+            chunk_data_[i] = nullptr;
+            if (Map::chunks[i]) {
+                Map::chunks[i]->stage_ = stage_none;
+            }
+        }
+        Decoration::ClearPending();
+    }
+
+    void ResetStats()
+    {
+        for (StageStats& stats : stage_stats_) {
+            stats.chunks = 0;
+            stats.ticks = 0;
+            stats.wall_seconds = 0;
+        }
+        NoiseCache::ResetStats();
+    }
+
+    void PrintStats()
+    {
+        printf("%-12s %8s %12s %10s %10s\n", "stage", "chunks", "total ms", "us/chunk", "wall ms");
+        for (int stage = stage_none + 1; stage < stage_count; stage++) {
+            const StageStats& stats = stage_stats_[stage];
+            double total_ms = Timer::ToMs(stats.ticks);
+            printf("%-12s %8d %12.2f %10.2f %10.2f\n", stage_names[stage], stats.chunks.load(), total_ms,
+                stats.chunks ? total_ms * 1000 / stats.chunks : 0.0, stats.wall_seconds * 1000);
+        }
+        NoiseCache::Stats cache = NoiseCache::GetStats();
+        int64_t lookups = cache.hits + cache.misses;
+        printf("noise cache: %lld hits, %lld misses (%.1f%% hits), %lld evictions, %d tiles in %lld KB\n", (long long) cache.hits,
+            (long long) cache.misses, lookups ? cache.hits * 100.0 / lookups : 0.0, (long long) cache.evictions, cache.tiles, (long long) cache.bytes / 1024);
+    }
+}
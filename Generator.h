@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+class Chunk;
+
+// Chunk generation split in stages, run in order for each chunk. Some stages need the neighbour chunks to have
+// reached an earlier stage first (structures reach into the neighbours, light spreads through them). Generate works
+// out which chunks around the requested ones need which stages, so the ring around them is only generated as far as
+// needed, and a later request only runs the stages a chunk hasn't done yet.
+namespace Generator
+{
+    enum Stage
+    {
+        stage_none,
+        // biome weights of the chunk's columns, from the cached climate regions
+        stage_climate,
+        // surface height of the columns the fill needs
+        stage_heightmap,
+        // solid or open cells, 3d density or heightmap
+        stage_fill,
+        // materials of the solid cells, water
+        stage_surface,
+        // trees and rocks, see Decoration
+        stage_decoration,
+        // cells the neighbours' structures queued for the chunk
+        stage_settle,
+        stage_lighting,
+        stage_count,
+    };
+    extern const char* stage_names[stage_count];
+
+    // 3d density terrain with caves and overhangs, the 2d heightmap when false
+    extern bool density_terrain;
+    // density is sampled every density_step cells and interpolated in between
+    constexpr int density_step = 4;
+    // heightmap noise read from NoiseCache tiles, computed for every chunk when false
+    extern bool use_noise_cache;
+
+    // Brings the chunks up to target, and their neighbours as far as the stages need. Stages run on the JobPool, one
+    // stage for all the chunks at a time, except lighting which runs on the calling thread.
+    void Generate(const std::vector<Chunk*>& chunks, Stage target);
+    // Frees what the chunks stopped before the surface stage still hold and drops the decoration writes queued for
+    // them, then puts every chunk of the map back to stage_none. Their cells are left as they are.
+    void Reset();
+
+    struct StageStats
+    {
+        std::atomic<int> chunks;
+        std::atomic<uint64_t> ticks; // Timer ticks, summed over the threads
+        double wall_seconds;
+    };
+    extern StageStats stage_stats_[stage_count];
+    // the stage stats and the NoiseCache hits
+    void ResetStats();
+    void PrintStats();
+}
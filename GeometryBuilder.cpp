@@ -17,6 +17,33 @@ void GeometryBuilder::PushQuad(vec3_t a, vec3_t b, vec3_t c, vec3_t d, vec3_t co
     ind.push_back(first_index + 3);
 }
 
+void GeometryBuilder::PushQuad(vec3_t a, vec3_t b, vec3_t c, vec3_t d, vec3_t col, const float shade[4])
+{
+    int first_index = vert.size();
+    vert.push_back({ { a.x, a.y, a.z }, { 0, 0 }, { col.x * shade[0], col.y * shade[0], col.z * shade[0], 1.f } });
+    vert.push_back({ { b.x, b.y, b.z }, { 0, 1 }, { col.x * shade[1], col.y * shade[1], col.z * shade[1], 1.f } });
+    vert.push_back({ { c.x, c.y, c.z }, { 1, 1 }, { col.x * shade[2], col.y * shade[2], col.z * shade[2], 1.f } });
+    vert.push_back({ { d.x, d.y, d.z }, { 1, 0 }, { col.x * shade[3], col.y * shade[3], col.z * shade[3], 1.f } });
+
+    // Split along the diagonal joining the two brightest corners. Split the other way, a single dark corner would be
+    // interpolated all along the diagonal and the shading would depend on the quad orientation.
+    if (shade[0] + shade[2] >= shade[1] + shade[3]) {
+        ind.push_back(first_index + 0);
+        ind.push_back(first_index + 1);
+        ind.push_back(first_index + 2);
+        ind.push_back(first_index + 0);
+        ind.push_back(first_index + 2);
+        ind.push_back(first_index + 3);
+    } else {
+        ind.push_back(first_index + 1);
+        ind.push_back(first_index + 2);
+        ind.push_back(first_index + 3);
+        ind.push_back(first_index + 1);
+        ind.push_back(first_index + 3);
+        ind.push_back(first_index + 0);
+    }
+}
+
 void GeometryBuilder::PushQuad(vec3_t a, vec3_t b, vec3_t c, vec3_t d, vec3_t col)
 {
     GeometryBuilder::PushQuad(a, b, c, d, col, 1.f);
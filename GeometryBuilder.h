@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdint.h>
 #include <vector>
 #include "types.h"
 
@@ -9,5 +10,7 @@ struct GeometryBuilder {
 
     void PushQuad(vec3_t a, vec3_t b, vec3_t c, vec3_t d, vec3_t col);
     void PushQuad(vec3_t a, vec3_t b, vec3_t c, vec3_t d, vec3_t col, float col_alpha);
+    // col darkened per vertex by shade (a, b, c, d order)
+    void PushQuad(vec3_t a, vec3_t b, vec3_t c, vec3_t d, vec3_t col, const float shade[4]);
 };
 
@@ -16,15 +16,29 @@
 #include <math.h>
 #include <float.h>
 #include <string.h>
+#include <stdio.h>
 #include <stddef.h>
 #include <vector>
+#include <thread>
+#include <atomic>
 
 #include "types.h"
 #include "Input.h"
 #include "GeometryBuilder.h"
 #include "Map.h"
 #include "ParticleSystem.h"
+#include "ParticleManager.h"
+#include "ParticleRenderer.h"
+#include "JobPool.h"
 #include "Chunk.h"
+#include "RenderRegion.h"
+#include "Benchmark.h"
+#include "Profiler.h"
+#include "Timer.h"
+#include "Game.h"
+#include "Replay.h"
+#include "FramePacket.h"
+#include "CommandBuffer.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -68,6 +82,14 @@ static LRESULT CALLBACK WindowProc(HWND wnd, UINT msg, WPARAM wparam, LPARAM lpa
     return DefWindowProcW(wnd, msg, wparam, lparam);
 }
 
+// must match cbuffer0 in the shaders
+struct ShaderConstants
+{
+    DirectX::XMMATRIX transform;
+    float camera_right[4];
+    float camera_up[4];
+};
+
 DirectX::XMMATRIX FPSViewMatrix(float pos_x, float pos_y, float pos_z, float rot_h, float rot_v)
 {
     DirectX::XMVECTOR DefaultForward = DirectX::XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
@@ -97,8 +119,66 @@ DirectX::XMMATRIX FPSViewMatrix(float pos_x, float pos_y, float pos_z, float rot
     return DirectX::XMMatrixLookAtLH(camPosition, camTarget, camUp);
 }
 
+// copies the word following flag in the command line to value, "-record out.replay" gives "out.replay"
+static bool CommandLineValue(const char* cmdline, const char* flag, char* value, int value_size)
+{
+    const char* found = strstr(cmdline, flag);
+    if (found == NULL) {
+        return false;
+    }
+    found += strlen(flag);
+    while (*found == ' ') {
+        found++;
+    }
+    int length = 0;
+    while (found[length] != '\0' && found[length] != ' ' && length < value_size - 1) {
+        value[length] = found[length];
+        length++;
+    }
+    value[length] = '\0';
+    return length > 0;
+}
+
+// The release configurations build for the Windows subsystem, where printf goes nowhere. The headless modes attach
+// to the console they were started from, or open one, unless the output is already a console or redirected.
+static void OpenConsole()
+{
+    HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (output != NULL && output != INVALID_HANDLE_VALUE) {
+        return;
+    }
+    if (!AttachConsole(ATTACH_PARENT_PROCESS)) {
+        AllocConsole();
+    }
+    FILE* file;
+    freopen_s(&file, "CONOUT$", "w", stdout);
+    freopen_s(&file, "CONOUT$", "w", stderr);
+}
+
 int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, int cmdshow)
 {
+    JobPool::Init();
+
+    // headless benchmarks, see Benchmark.h
+    if (strstr(cmdline, "-bench")) {
+        OpenConsole();
+        Benchmark::Run();
+        JobPool::Shutdown();
+        return 0;
+    }
+
+    // headless playback of a recording made with -record, see Replay.h
+    char replay_path[MAX_PATH];
+    if (CommandLineValue(cmdline, "-replay", replay_path, sizeof(replay_path))) {
+        OpenConsole();
+        bool replayed = Replay::RunHeadless(replay_path);
+        JobPool::Shutdown();
+        return replayed ? 0 : 1;
+    }
+    if (CommandLineValue(cmdline, "-record", replay_path, sizeof(replay_path))) {
+        Replay::StartRecording(replay_path);
+    }
+
     // register window class to have custom WindowProc callback
     WNDCLASSEXW wc =
     {
@@ -253,30 +333,22 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
     geom.PushQuad(a, b, c, d, vec3(1.f,0.2f,0.2f));*/
 
     Map::GenerateTerrain();
-    
-    {
-        vec3_t grass_light = vec3(0.1f, 0.9f, 0.1f);
-        vec3_t grass_dark = vec3(0.05f, 0.8f, 0.05f);
-        vec3_t dirt_col = vec3(115.f / 256, 63.f / 256, 23.f / 256);
-        vec3_t stone_col = vec3(120.f / 256, 120.f / 256, 120.f / 256);
-        vec3_t water_col = vec3(100.f / 256, 110.f / 256, 220.f / 256);
-
-        for (int chunk_y = 0; chunk_y < Map::max_chunks_y; chunk_y++) {
-            for (int chunk_x = 0; chunk_x < Map::max_chunks_x; chunk_x++) {
-                /*Chunk* chunk = Map::chunks[chunk_x + chunk_yMap::chunks[chunk_x + chunk_y * Map::max_chunks_x];
-                chunk->UpdateGeometryBuffers(device, context);*/
-            }
+
+    Game::Init();
+
+    // instance buffers of the particle systems, filled by the render thread from the FramePacket
+    ParticleRenderer particle_renderer;
+    particle_renderer.Init(device, Game::particles);
+
+    // chunks are drawn through render regions, see RenderRegion.h. They belong to the render thread, the meshes get
+    // there through the FramePacket.
+    RenderRegion* regions[Game::regions_x * Game::regions_y];
+    for (int region_y = 0; region_y < Game::regions_y; region_y++) {
+        for (int region_x = 0; region_x < Game::regions_x; region_x++) {
+            regions[region_x + region_y * Game::regions_x] = new RenderRegion(region_x, region_y);
         }
     }
 
-    ParticleSystem particle_system = ParticleSystem(device, 100);
-    ParticleSystem particle_system2 = ParticleSystem(device, 6000);
-    particle_system2.pos_ = vec3(3, 19, 0);
-    particle_system2.target_velocity_ = vec3(0, -1, 0);
-    particle_system2.spawn_volume_size_ = vec3(40, 0, 40);
-    particle_system2.lifetime_ = 12.0f;
-    particle_system2.spawn_rate_ = 0.01f;
-
     /*ID3D11Buffer* vbuffer;
     {
         D3D11_BUFFER_DESC desc =
@@ -308,6 +380,9 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
     ID3D11InputLayout* layout;
     ID3D11VertexShader* vshader;
     ID3D11PixelShader* pshader;
+    // particles use their own vertex shader, reading one ParticleInstance per quad
+    ID3D11InputLayout* particle_layout;
+    ID3D11VertexShader* particle_vshader;
     {
         // these must match vertex shader input layout (VS_INPUT in vertex shader source below)
         D3D11_INPUT_ELEMENT_DESC desc[] = {
@@ -316,6 +391,13 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
             { "COLOR",    0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offsetof(struct Vertex, color),    D3D11_INPUT_PER_VERTEX_DATA, 0 },
         };
 
+        // these must match VS_PARTICLE_INPUT
+        D3D11_INPUT_ELEMENT_DESC particle_desc[] = {
+            { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(struct ParticleInstance, position), D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+            { "ROTATION", 0, DXGI_FORMAT_R32_FLOAT,       0, offsetof(struct ParticleInstance, rotation), D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+            { "AGE",      0, DXGI_FORMAT_R32_FLOAT,       0, offsetof(struct ParticleInstance, age),      D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        };
+
 #if 0
         // alternative to hlsl compilation at runtime is to precompile shaders offline
         // it improves startup time - no need to parse hlsl files at runtime!
@@ -325,6 +407,7 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
         // b) run hlsl compiler to compile shader, these run compilation with optimizations and without debug info:
         //      fxc.exe /nologo /T vs_5_0 /E vs /O3 /WX /Zpc /Ges /Fh d3d11_vshader.h /Vn d3d11_vshader /Qstrip_reflect /Qstrip_debug /Qstrip_priv shader.hlsl
         //      fxc.exe /nologo /T ps_5_0 /E ps /O3 /WX /Zpc /Ges /Fh d3d11_pshader.h /Vn d3d11_pshader /Qstrip_reflect /Qstrip_debug /Qstrip_priv shader.hlsl
+        //      fxc.exe /nologo /T vs_5_0 /E vs_particle /O3 /WX /Zpc /Ges /Fh d3d11_vshader_particle.h /Vn d3d11_vshader_particle /Qstrip_reflect /Qstrip_debug /Qstrip_priv shader.hlsl
         //    they will save output to d3d11_vshader.h and d3d11_pshader.h files
         // c) change #if 0 above to #if 1
 
@@ -333,10 +416,13 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
 
 #include "d3d11_vshader.h"
 #include "d3d11_pshader.h"
+#include "d3d11_vshader_particle.h"
 
         ID3D11Device_CreateVertexShader(device, d3d11_vshader, sizeof(d3d11_vshader), NULL, &vshader);
         ID3D11Device_CreatePixelShader(device, d3d11_pshader, sizeof(d3d11_pshader), NULL, &pshader);
         ID3D11Device_CreateInputLayout(device, desc, ARRAYSIZE(desc), d3d11_vshader, sizeof(d3d11_vshader), &layout);
+        ID3D11Device_CreateVertexShader(device, d3d11_vshader_particle, sizeof(d3d11_vshader_particle), NULL, &particle_vshader);
+        ID3D11Device_CreateInputLayout(device, particle_desc, ARRAYSIZE(particle_desc), d3d11_vshader_particle, sizeof(d3d11_vshader_particle), &particle_layout);
 #else
         const char hlsl[] =
             "#line " STR(__LINE__) "                                  \n\n" // actual line number in this file for nicer error messages
@@ -358,6 +444,8 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
             "cbuffer cbuffer0 : register(b0)                            \n" // b0 = constant buffer bound to slot 0
             "{                                                          \n"
             "    float4x4 uTransform;                                   \n"
+            "    float4 uCameraRight;                                   \n" // used to orient the particle billboards
+            "    float4 uCameraUp;                                      \n"
             "}                                                          \n"
             "                                                           \n"
             "sampler sampler0 : register(s0);                           \n" // s0 = sampler bound to slot 0
@@ -373,6 +461,33 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
             "    return output;                                         \n"
             "}                                                          \n"
             "                                                           \n"
+            "struct VS_PARTICLE_INPUT                                   \n"
+            "{                                                          \n"
+            "     float3 center   : POSITION;                           \n" // per instance, see ParticleInstance
+            "     float  rotation : ROTATION;                           \n"
+            "     float  age      : AGE;                                \n"
+            "     uint   vertex   : SV_VertexID;                        \n"
+            "};                                                         \n"
+            "                                                           \n"
+            "PS_INPUT vs_particle(VS_PARTICLE_INPUT input)              \n"
+            "{                                                          \n"
+            "    // two triangles, same winding as GeometryBuilder::PushQuad \n"
+            "    static const float2 corners[6] = { float2(-1,-1), float2(-1,1), float2(1,1), float2(-1,-1), float2(1,1), float2(1,-1) }; \n"
+            "    float2 corner = corners[input.vertex];                 \n"
+            "    float t = input.age;                                   \n"
+            "    float size = (1 - (t*2 - 1) * (t*2 - 1)) * 0.3;        \n"
+            "    float s, c;                                            \n"
+            "    sincos(input.rotation, s, c);                          \n"
+            "    float3 local_x = (uCameraRight.xyz * c - uCameraUp.xyz * s) * size; \n"
+            "    float3 local_y = (uCameraRight.xyz * s + uCameraUp.xyz * c) * size; \n"
+            "    float3 pos = input.center + local_x * corner.x + local_y * corner.y; \n"
+            "    PS_INPUT output;                                       \n"
+            "    output.pos = mul(uTransform, float4(pos, 1));          \n"
+            "    output.uv = corner * 0.5 + 0.5;                        \n"
+            "    output.color = lerp(float4(1,1,1,t), float4(0,0,0,1), 0.1); \n"
+            "    return output;                                         \n"
+            "}                                                          \n"
+            "                                                           \n"
             "float4 ps(PS_INPUT input) : SV_TARGET                      \n"
             "{                                                          \n"
             "    float4 tex = texture0.Sample(sampler0, input.uv);      \n"
@@ -407,10 +522,22 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
             Assert(!"Failed to compile pixel shader!");
         }
 
+        ID3DBlob* particle_vblob;
+        hr = D3DCompile(hlsl, sizeof(hlsl), NULL, NULL, NULL, "vs_particle", "vs_5_0", flags, 0, &particle_vblob, &error);
+        if (FAILED(hr))
+        {
+            const char* message = (const char*)error->GetBufferPointer();
+            OutputDebugStringA(message);
+            Assert(!"Failed to compile particle vertex shader!");
+        }
+
         device->CreateVertexShader(vblob->GetBufferPointer(), vblob->GetBufferSize(), NULL, &vshader);
         device->CreatePixelShader(pblob->GetBufferPointer(), pblob->GetBufferSize(), NULL, &pshader);
         device->CreateInputLayout(desc, ARRAYSIZE(desc), vblob->GetBufferPointer(), vblob->GetBufferSize(), &layout);
+        device->CreateVertexShader(particle_vblob->GetBufferPointer(), particle_vblob->GetBufferSize(), NULL, &particle_vshader);
+        device->CreateInputLayout(particle_desc, ARRAYSIZE(particle_desc), particle_vblob->GetBufferPointer(), particle_vblob->GetBufferSize(), &particle_layout);
 
+        particle_vblob->Release();
         pblob->Release();
         vblob->Release();
 #endif
@@ -420,8 +547,8 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
     {
         D3D11_BUFFER_DESC desc =
         {
-            // space for 4x4 float matrix (cbuffer0 from pixel shader)
-            .ByteWidth = 4 * 4 * sizeof(float),
+            // space for 4x4 float matrix and the two camera vectors (cbuffer0 from vertex shader)
+            .ByteWidth = sizeof(ShaderConstants),
             .Usage = D3D11_USAGE_DYNAMIC,
             .BindFlags = D3D11_BIND_CONSTANT_BUFFER,
             .CPUAccessFlags = D3D11_CPU_ACCESS_WRITE,
@@ -579,43 +706,81 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
         device->CreateDepthStencilState(&desc, &depthStateTransparent);
     }
 
+    // profiler overlay, a fixed number of quads so the buffers are created once
+    constexpr int overlay_max_quads = Profiler::history_size * (Profiler::zone_count + 1) + 1;
+    GeometryBuilder overlay;
+    ID3D11Buffer* overlay_vbuffer;
+    {
+        D3D11_BUFFER_DESC desc =
+        {
+            .ByteWidth = static_cast<UINT>(overlay_max_quads * 4 * sizeof(Vertex)),
+            .Usage = D3D11_USAGE_DYNAMIC,
+            .BindFlags = D3D11_BIND_VERTEX_BUFFER,
+            .CPUAccessFlags = D3D10_CPU_ACCESS_WRITE,
+        };
+        device->CreateBuffer(&desc, nullptr, &overlay_vbuffer);
+    }
+    ID3D11Buffer* overlay_ibuffer;
+    {
+        D3D11_BUFFER_DESC desc =
+        {
+            .ByteWidth = static_cast<UINT>(overlay_max_quads * 6 * sizeof(uint32_t)),
+            .Usage = D3D11_USAGE_DYNAMIC,
+            .BindFlags = D3D11_BIND_INDEX_BUFFER,
+            .CPUAccessFlags = D3D10_CPU_ACCESS_WRITE,
+        };
+        device->CreateBuffer(&desc, nullptr, &overlay_ibuffer);
+    }
+
     ID3D11RenderTargetView* rtView = NULL;
     ID3D11DepthStencilView* dsView = NULL;
 
     // show the window
     ShowWindow(window, SW_SHOWDEFAULT);
 
-    LARGE_INTEGER freq, c1;
-    QueryPerformanceFrequency(&freq);
-    QueryPerformanceCounter(&c1);
+    // The game thread (this one) pumps the messages, ticks the game and fills a FramePacket per frame, the render
+    // thread draws the packets and presents, so vsync doesn't block the simulation. Set to false to do both on this
+    // thread, one after the other.
+    constexpr bool use_render_thread = true;
+    FrameQueue frame_queue;
 
-    float angle = 0;
+    // render thread state, only touched in render_frame
     DWORD currentWidth = 0;
     DWORD currentHeight = 0;
 
-    // main loop
-    for (;;)
-    {
-        // process all incoming Windows messages
-        MSG msg;
-        if (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE))
-        {
-            if (msg.message == WM_QUIT)
-            {
-                break;
-            }
-            TranslateMessage(&msg);
-            DispatchMessageW(&msg);
-            continue;
+    // Chunk draws are recorded by the workers, one command buffer per batch of regions. When the driver builds command
+    // lists itself the workers also replay their buffer on a per batch D3D11 deferred context, so the D3D calls run in
+    // parallel and the render thread only executes the command lists. Without driver support the runtime emulates
+    // command lists on the immediate context, which gains nothing, the buffers are executed there directly instead.
+    // -immediate forces that path, to compare.
+    D3D11_FEATURE_DATA_THREADING threading = {};
+    device->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading));
+    bool use_deferred_contexts = threading.DriverCommandLists && !strstr(cmdline, "-immediate");
+    std::vector<CommandBuffer> command_buffers(JobPool::ThreadCount() + 1);
+    std::vector<ID3D11DeviceContext*> deferred_contexts;
+    std::vector<ID3D11CommandList*> command_lists(command_buffers.size());
+    if (use_deferred_contexts) {
+        deferred_contexts.resize(command_buffers.size());
+        for (ID3D11DeviceContext*& deferred_context : deferred_contexts) {
+            hr = device->CreateDeferredContext(0, &deferred_context);
+            AssertHR(hr);
+        }
+    }
+    // draw call counters for the title bar, which can only be set from this thread
+    std::atomic<int> rendered_draw_calls = 0;
+    std::atomic<int> rendered_chunk_draws = 0;
+
+    auto render_frame = [&](FramePacket* packet) {
+        // meshes built by the game thread since the previous packet, the old ones come back in the packet and are
+        // dropped with it
+        for (FramePacket::MeshUpload& upload : packet->mesh_uploads) {
+            int region_index = upload.chunk_x / RenderRegion::chunks_x + (upload.chunk_y / RenderRegion::chunks_y) * Game::regions_x;
+            regions[region_index]->SetChunkMesh(upload.chunk_x, upload.chunk_y, &upload.mesh);
         }
 
-        Input::Tick();
-
-        // get current size for window client area
-        RECT rect;
-        GetClientRect(window, &rect);
-        width = rect.right - rect.left;
-        height = rect.bottom - rect.top;
+        int width = packet->width;
+        int height = packet->height;
+        HRESULT hr;
 
         // resize swap chain if needed
         if (rtView == NULL || width != currentWidth || height != currentHeight)
@@ -670,32 +835,6 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
         // can render only if window size is non-zero - we must have backbuffer & RenderTarget view created
         if (rtView)
         {
-            LARGE_INTEGER c2;
-            QueryPerformanceCounter(&c2);
-            float delta = (float)((double)(c2.QuadPart - c1.QuadPart) / freq.QuadPart);
-            c1 = c2;
-
-            if (Input::state.jump) {
-                static float hey = 0;
-                particle_system.Spawn();
-                hey += 1.0f;
-                //geom.ind.clear();
-                //geom.vert.clear();
-
-                //static float t = 0;
-                //t += delta;
-                //geom.PushQuad(a, b, c, d, vec3(0.2f, 0.9f, 0.2f));
-
-                //// Update vertex buffer
-                //{
-                //    D3D11_MAPPED_SUBRESOURCE mapped_resource = {};
-                //    context->Map(vbuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
-                //    memcpy(mapped_resource.pData, particle_system.builder_.vert.data(), particle_system.builder_.vert.size() * sizeof(geom.vert[0]));
-                //    context->Unmap(vbuffer, 0);
-                //}
-
-            }
-
             // output viewport covering all client area of window
             D3D11_VIEWPORT viewport =
             {
@@ -712,49 +851,9 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
             context->ClearRenderTargetView(rtView, color);
             context->ClearDepthStencilView(dsView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.f, 0);
 
-            static vec3_t pos = {0, 0, -2};
-            static float rot_h = 0.f;
-            static float rot_v = 0.f;
             {
-                angle += delta * 2.0f * (float)M_PI / 20.0f; // full rotation in 20 seconds
-                angle = fmodf(angle, 2.0f * (float)M_PI);
-
-                static float time = 0;
-                time += 1.f / 60.f;  
-
-
-                rot_h += Input::state.mouse_delta_x * 0.01f;
-                rot_v += Input::state.mouse_delta_y * 0.01f;
-
-                constexpr float speed = 0.2f;
-                if (Input::state.w) {
-                    pos.z -= speed * -cosf(rot_h);
-                    pos.x += speed * sinf(rot_h);
-                }
-                if (Input::state.s) {
-                    pos.z += speed * -cosf(rot_h);
-                    pos.x -= speed * sinf(rot_h);
-                }
-                if (Input::state.d) {
-                    pos.x -= speed * -cosf(rot_h);
-                    pos.z -= speed * sinf(rot_h);
-                }
-                if (Input::state.a) {
-                    pos.x += speed * -cosf(rot_h);
-                    pos.z += speed * sinf(rot_h);
-                }
-                if (Input::state.d) {
-                    pos.x -= speed * -cosf(rot_h);
-                    pos.z -= speed * sinf(rot_h);
-                }
-                if (Input::state.e) {
-                    pos.y += speed;
-                }
-                if (Input::state.q) {
-                    pos.y -= speed;
-                }
-
-                DirectX::XMMATRIX view_matrix = FPSViewMatrix(pos.x, pos.y, pos.z, rot_h, rot_v);
+                const Game::Camera& camera = packet->camera;
+                DirectX::XMMATRIX view_matrix = FPSViewMatrix(camera.pos.x, camera.pos.y, camera.pos.z, camera.rot_h, camera.rot_v);
 
                 // Create the projection matrix for 3D rendering.
                 constexpr float degrees_to_radian = 0.0174532925f;
@@ -764,58 +863,95 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
 
                 DirectX::XMMATRIX combined_matrix = DirectX::XMMatrixMultiply(view_matrix, projection_matrix);
 
+                // particles stay upright and only turn with the horizontal rotation of the camera
+                ShaderConstants constants = {
+                    .transform = combined_matrix,
+                    .camera_right = { cosf(camera.rot_h), 0, -sinf(camera.rot_h), 0 },
+                    .camera_up = { 0, 1, 0, 0 },
+                };
+
                 // Map the final matrix
                 D3D11_MAPPED_SUBRESOURCE mapped;
                 context->Map((ID3D11Resource*)ubuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-                memcpy(mapped.pData, &combined_matrix, sizeof(combined_matrix));
+                memcpy(mapped.pData, &constants, sizeof(constants));
                 context->Unmap((ID3D11Resource*)ubuffer, 0);
             }
 
-            // Input Assembler
-            context->IASetInputLayout(layout);
-            context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-            // Vertex Shader
-            context->VSSetConstantBuffers(0, 1, &ubuffer);
-            context->VSSetShader(vshader, NULL, 0);
+            // chunk pipeline state, set on the immediate context and on every deferred context which start empty
+            auto bind_chunk_pipeline = [&](ID3D11DeviceContext* target) {
+                // Input Assembler
+                target->IASetInputLayout(layout);
+                target->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+                // Vertex Shader
+                target->VSSetConstantBuffers(0, 1, &ubuffer);
+                target->VSSetShader(vshader, NULL, 0);
+
+                // Rasterizer Stage
+                target->RSSetViewports(1, &viewport);
+                target->RSSetState(rasterizerState);
+
+                // Pixel Shader
+                target->PSSetSamplers(0, 1, &sampler);
+                target->PSSetShaderResources(0, 1, &texture_block);
+                target->PSSetShader(pshader, NULL, 0);
+
+                // Output Merger
+                target->OMSetBlendState(blendState, NULL, ~0U);
+                target->OMSetDepthStencilState(depthState, 0);
+                target->OMSetRenderTargets(1, &rtView, dsView);
+            };
+            bind_chunk_pipeline(context);
 
-            // Rasterizer Stage
-            context->RSSetViewports(1, &viewport);
-            context->RSSetState(rasterizerState);
+            Profiler::BeginZone(Profiler::zone_chunk_render);
 
-            // Pixel Shader
-            context->PSSetSamplers(0, 1, &sampler);
-            context->PSSetShaderResources(0, 1, &texture_block);
-            context->PSSetShader(pshader, NULL, 0);
+            // buffer updates map on the immediate context, before any recording
+            for (int i = 0; i < Game::regions_x * Game::regions_y; i++) {
+                if (packet->visible_masks[i] != 0 && regions[i]->dirty_) {
+                    regions[i]->UpdateGeometryBuffers(device, context);
+                }
+            }
 
-            // Output Merger
-            context->OMSetBlendState(blendState, NULL, ~0U);
-            context->OMSetDepthStencilState(depthState, 0);
-            context->OMSetRenderTargets(1, &rtView, dsView);
-
-            int player_chunk_x = floorl(pos.x / Chunk::sx);
-            int player_chunk_y = floorl(pos.z / Chunk::sy);
-
-            for (int chunk_y = 0; chunk_y < Map::max_chunks_y; chunk_y++) {
-                for (int chunk_x = 0; chunk_x < Map::max_chunks_x; chunk_x++) {
-                    int dx = abs(player_chunk_x - chunk_x);
-                    int dy = abs(player_chunk_y - chunk_y);
-                    Chunk* chunk = Map::chunks[chunk_x + chunk_y * Map::max_chunks_x];
-                    if ((dx * dx) + (dy * dy) > 8 * 8) {
-                        //if (chunk) {   
-                        //    chunk->dirty_ = true;
-                        //    Map::chunks[chunk_x + chunk_y * Map::max_chunks_x] = nullptr;
-                        //    Map::free_chunks.push_back(chunk);
-                        //}
-                        continue;
+            // Each batch of regions is recorded on the JobPool into its own command buffer, executed in batch order
+            // afterwards. With deferred contexts the workers also turn their buffer into a D3D command list.
+            // set merge_chunk_draws to false to get one draw call per chunk, to compare
+            constexpr bool merge_chunk_draws = true;
+            constexpr int region_count = Game::regions_x * Game::regions_y;
+            int batch_count = (int) command_buffers.size();
+            JobPool::ParallelFor(batch_count, 1, [&](int begin, int end) {
+                for (int batch = begin; batch < end; batch++) {
+                    CommandBuffer& commands = command_buffers[batch];
+                    commands.Clear();
+                    for (int i = region_count * batch / batch_count; i < region_count * (batch + 1) / batch_count; i++) {
+                        if (packet->visible_masks[i] != 0) {
+                            regions[i]->Record(&commands, packet->visible_masks[i], merge_chunk_draws);
+                        }
+                    }
+                    if (use_deferred_contexts) {
+                        bind_chunk_pipeline(deferred_contexts[batch]);
+                        commands.Execute(deferred_contexts[batch]);
+                        deferred_contexts[batch]->FinishCommandList(FALSE, &command_lists[batch]);
                     }
-                    //if (chunk == nullptr) {
-                    //    chunk = new Chunk(chunk_x, chunk_y);
-                    //    Map::chunks[chunk_x + chunk_y * Map::max_chunks_x] = chunk;
-                    //}
-                    chunk->Render(device, context);
                 }
+            });
+            for (int batch = 0; batch < batch_count; batch++) {
+                if (use_deferred_contexts) {
+                    context->ExecuteCommandList(command_lists[batch], TRUE);
+                    command_lists[batch]->Release();
+                } else {
+                    command_buffers[batch].Execute(context);
+                }
+            }
+            Profiler::EndZone(Profiler::zone_chunk_render);
+            // counted per batch, summed once the workers are done
+            int draw_calls = 0;
+            int chunk_draws = 0;
+            for (const CommandBuffer& commands : command_buffers) {
+                draw_calls += commands.draw_count_;
+                chunk_draws += commands.chunk_draw_count_;
             }
+            rendered_draw_calls = draw_calls;
+            rendered_chunk_draws = chunk_draws;
 
             // draw
             //context->DrawIndexed(geom.ind.size(), 0, 0);
@@ -827,16 +963,53 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
 
             context->OMSetDepthStencilState(depthStateTransparent, 0);
 
-            particle_system2.pos_.x = pos.x;
-            particle_system2.pos_.z = pos.z;
+            // Particles are instanced, no index buffer: 6 vertices per instance, expanded in vs_particle
+            context->IASetInputLayout(particle_layout);
+            context->VSSetShader(particle_vshader, NULL, 0);
+
+            {
+                Profiler::Scope scope(Profiler::zone_particle_upload);
+                particle_renderer.Upload(context, packet->particle_instances);
+                particle_renderer.Render(context, packet->particle_instances);
+            }
+
+            // profiler overlay, in pixels with the origin at the bottom left, drawn over everything
+            if (packet->profiler_overlay) {
+                overlay.vert.clear();
+                overlay.ind.clear();
+                Profiler::BuildOverlay(&overlay, (float) width, (float) height);
+
+                D3D11_MAPPED_SUBRESOURCE mapped;
+                context->Map((ID3D11Resource*)overlay_vbuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+                memcpy(mapped.pData, overlay.vert.data(), overlay.vert.size() * sizeof(Vertex));
+                context->Unmap((ID3D11Resource*)overlay_vbuffer, 0);
+                context->Map((ID3D11Resource*)overlay_ibuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+                memcpy(mapped.pData, overlay.ind.data(), overlay.ind.size() * sizeof(uint32_t));
+                context->Unmap((ID3D11Resource*)overlay_ibuffer, 0);
+
+                ShaderConstants constants = {
+                    .transform = DirectX::XMMatrixOrthographicOffCenterLH(0, (float) width, 0, (float) height, 0, 1),
+                };
+                context->Map((ID3D11Resource*)ubuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+                memcpy(mapped.pData, &constants, sizeof(constants));
+                context->Unmap((ID3D11Resource*)ubuffer, 0);
 
-            particle_system.UpdateAndRender(context, delta, vec3(sinf(-rot_h), 0, -cosf(-rot_h)));
-            particle_system2.UpdateAndRender(context, delta, vec3(sinf(-rot_h), 0, -cosf(-rot_h)));
+                UINT stride = sizeof(Vertex);
+                UINT offset = 0;
+                context->IASetInputLayout(layout);
+                context->IASetVertexBuffers(0, 1, &overlay_vbuffer, &stride, &offset);
+                context->IASetIndexBuffer(overlay_ibuffer, DXGI_FORMAT_R32_UINT, 0);
+                context->VSSetShader(vshader, NULL, 0);
+                context->PSSetShaderResources(0, 1, &texture_block);
+                context->DrawIndexed((UINT) overlay.ind.size(), 0, 0);
+            }
         }
 
         // change to FALSE to disable vsync
         BOOL vsync = TRUE;
+        Profiler::BeginZone(Profiler::zone_present);
         hr = swapChain->Present(vsync ? 1 : 0, 0);
+        Profiler::EndZone(Profiler::zone_present);
         if (hr == DXGI_STATUS_OCCLUDED)
         {
             // window is minimized, cannot vsync - instead sleep a bit
@@ -849,7 +1022,118 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE previnstance, LPSTR cmdline, in
         {
             FatalError("Failed to present swap chain! Device lost?");
         }
+    };
+
+    std::thread render_thread;
+    if (use_render_thread) {
+        render_thread = std::thread([&] {
+            while (FramePacket* packet = frame_queue.BeginRead()) {
+                render_frame(packet);
+                frame_queue.EndRead();
+            }
+        });
+    }
+
+    uint64_t last_frame_ticks = Timer::Now();
+    int frame_index = 0;
+
+    // main loop
+    for (;;)
+    {
+        // process all incoming Windows messages
+        MSG msg;
+        if (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE))
+        {
+            if (msg.message == WM_QUIT)
+            {
+                break;
+            }
+            TranslateMessage(&msg);
+            DispatchMessageW(&msg);
+            continue;
+        }
+
+        Profiler::BeginFrame();
+        Profiler::BeginZone(Profiler::zone_input);
+        Input::Tick();
+
+        // get current size for window client area
+        RECT rect;
+        GetClientRect(window, &rect);
+        width = rect.right - rect.left;
+        height = rect.bottom - rect.top;
+
+        uint64_t now_ticks = Timer::Now();
+        float delta = (float) Timer::ToSeconds(now_ticks - last_frame_ticks);
+        last_frame_ticks = now_ticks;
+
+        if (Input::state.profiler_export) {
+            Profiler::ExportCsv("profile.csv");
+            Profiler::ExportChromeTrace("profile_trace.json");
+        }
+
+        Profiler::EndZone(Profiler::zone_input);
+
+        // everything but the drawing, at a fixed tick rate. The same code runs headless with -replay
+        Replay::RecordFrame(Input::state, delta);
+        float tick_alpha = Game::Update(Input::state, delta);
+
+        FramePacket* packet = frame_queue.BeginWrite();
+        packet->frame_index = frame_index++;
+        packet->width = width;
+        packet->height = height;
+        packet->profiler_overlay = Input::state.profiler_overlay;
+        Game::FillPacket(packet, tick_alpha);
 
         Input::state.jump = false; // huge hack, need to reset before polling events.
+        Input::state.profiler_export = false;
+
+        // Waits for the render thread if it is more than a frame behind, handling the window messages in between.
+        // DXGI can send messages to the window from ResizeBuffers and Present and wait for them, so blocking this
+        // thread until the render thread is done could deadlock.
+        bool quit = false;
+        while (!quit && !frame_queue.EndWrite(1)) {
+            MSG wait_msg;
+            while (PeekMessageW(&wait_msg, NULL, 0, 0, PM_REMOVE)) {
+                if (wait_msg.message == WM_QUIT) {
+                    quit = true;
+                    break;
+                }
+                TranslateMessage(&wait_msg);
+                DispatchMessageW(&wait_msg);
+            }
+        }
+        if (quit) {
+            break;
+        }
+
+        if (!use_render_thread) {
+            render_frame(frame_queue.BeginRead());
+            frame_queue.EndRead();
+        }
+
+        // report the draw call counter and the frame times in the title bar, the times twice a second is enough
+        static int last_draw_calls = -1;
+        static int title_frame = 0;
+        if (rendered_draw_calls != last_draw_calls || ++title_frame >= 30) {
+            last_draw_calls = rendered_draw_calls;
+            title_frame = 0;
+            Profiler::Stats frame_stats = Profiler::GetStats(Profiler::zone_count);
+            char title[192];
+            snprintf(title, sizeof(title), "D3D11 Window - %d chunk draw calls (%d without merging, %s) - frame %.2fms avg, %.2fms p99",
+                (int) rendered_draw_calls, (int) rendered_chunk_draws, use_deferred_contexts ? "deferred" : "immediate", frame_stats.avg_ms, frame_stats.p99_ms);
+            SetWindowTextA(window, title);
+        }
+
+        Profiler::EndFrame();
+    }
+
+    frame_queue.Quit();
+    if (render_thread.joinable()) {
+        render_thread.join();
     }
+    Replay::StopRecording();
+    // the workers have to be joined before the statics holding them are destroyed
+    JobPool::Shutdown();
+    return 0;
 }
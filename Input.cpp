@@ -1,7 +1,3 @@
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
-#include <Windowsx.h>
-
 #include "Input.h"
 
 namespace Input
@@ -14,6 +10,7 @@ namespace Input
 
 	State state;
 
+#ifdef _WIN32
 	/// <returns>true if we used the message</returns>
 	bool HandleInput(HWND wnd, UINT msg, WPARAM wparam, LPARAM lparam)
 	{
@@ -53,6 +50,25 @@ namespace Input
 					state.jump = true;
 					return true;
 				}
+				if (wparam == 'F') {
+					// bit 30 is set on autorepeat, holding the key toggles once
+					if (lparam & (1 << 30)) {
+						return true;
+					}
+					state.fly = !state.fly;
+					return true;
+				}
+				if (wparam == 'P') {
+					if (lparam & (1 << 30)) {
+						return true;
+					}
+					state.profiler_overlay = !state.profiler_overlay;
+					return true;
+				}
+				if (wparam == 'O') {
+					state.profiler_export = true;
+					return true;
+				}
 				break;
 			}
 			case WM_KEYUP: {
@@ -85,6 +101,7 @@ namespace Input
 		}
 		return false;
 	}
+#endif
 
 	void Tick()
 	{
@@ -1,8 +1,10 @@
 #pragma once
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 #include <Windowsx.h>
+#endif
 
 namespace Input {
 	struct State {
@@ -15,12 +17,20 @@ namespace Input {
 		float mouse_delta_x;
 		float mouse_delta_y;
 		bool jump;
+		// toggled by F, free camera instead of walking
+		bool fly;
+		// toggled by P
+		bool profiler_overlay;
+		// set for one frame by O
+		bool profiler_export;
 	};
 
 	extern State state;
 
+#ifdef _WIN32
 	/// <returns>true if we used the message</returns>
 	bool HandleInput(HWND wnd, UINT msg, WPARAM wparam, LPARAM lparam);
+#endif
 
 	void Tick();
 };
@@ -0,0 +1,73 @@
+#include "Instrument.h"
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+
+namespace Instrument
+{
+    static Zone zones_[max_zones];
+    static std::atomic<int> zone_count_ = 0;
+    static std::mutex register_mutex_;
+
+    Zone* Register(const char* name)
+    {
+        // only taken the first time each INSTRUMENT_ZONE runs, the pointer is cached in a static after that
+        std::lock_guard<std::mutex> lock(register_mutex_);
+        Zone* zone = FindZone(name);
+        if (zone) {
+            return zone;
+        }
+        int index = zone_count_.load();
+        if (index == max_zones) {
+            printf("Instrument: too many zones, %s is merged into %s\n", name, zones_[max_zones - 1].name);
+            return &zones_[max_zones - 1];
+        }
+        zones_[index].name = name;
+        zone_count_.store(index + 1);
+        return &zones_[index];
+    }
+
+    int ZoneCount()
+    {
+        return zone_count_.load();
+    }
+
+    Zone* GetZone(int index)
+    {
+        return &zones_[index];
+    }
+
+    Zone* FindZone(const char* name)
+    {
+        int count = zone_count_.load();
+        for (int i = 0; i < count; i++) {
+            if (strcmp(zones_[i].name, name) == 0) {
+                return &zones_[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void Reset()
+    {
+        int count = zone_count_.load();
+        for (int i = 0; i < count; i++) {
+            zones_[i].count = 0;
+            zones_[i].ticks = 0;
+        }
+    }
+
+    void Print()
+    {
+        printf("%-40s %10s %12s %12s\n", "zone", "count", "total ms", "avg us");
+        int count = zone_count_.load();
+        for (int i = 0; i < count; i++) {
+            uint64_t calls = zones_[i].count.load();
+            if (calls == 0) {
+                continue;
+            }
+            double total_ms = Timer::ToMs(zones_[i].ticks.load());
+            printf("%-40s %10llu %12.3f %12.3f\n", zones_[i].name, (unsigned long long) calls, total_ms, calls ? total_ms * 1000.0 / calls : 0.0);
+        }
+    }
+}
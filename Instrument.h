@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include "Timer.h"
+
+// Named zones counting how many times a piece of code ran and how long it took in total, from any thread.
+// Put INSTRUMENT_ZONE("Module::Function") at the top of a scope. Building with INSTRUMENT_ENABLED=0 compiles the
+// zones out entirely.
+#ifndef INSTRUMENT_ENABLED
+#define INSTRUMENT_ENABLED 1
+#endif
+
+namespace Instrument
+{
+    constexpr int max_zones = 128;
+
+    struct Zone
+    {
+        const char* name;
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> ticks;
+    };
+
+    // Returns the zone with this name, created on first use. Names are compared by content and must outlive the registry.
+    Zone* Register(const char* name);
+
+    int ZoneCount();
+    Zone* GetZone(int index);
+    Zone* FindZone(const char* name);
+    void Reset();
+    void Print();
+
+    struct ScopedZone
+    {
+        Zone* zone_;
+        uint64_t start_;
+        ScopedZone(Zone* zone) : zone_(zone), start_(Timer::Now()) {}
+        ~ScopedZone()
+        {
+            zone_->ticks.fetch_add(Timer::Now() - start_, std::memory_order_relaxed);
+            zone_->count.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+}
+
+#define INSTRUMENT_CONCAT_(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b) INSTRUMENT_CONCAT_(a, b)
+
+#if INSTRUMENT_ENABLED
+#define INSTRUMENT_ZONE(name) \
+    static Instrument::Zone* INSTRUMENT_CONCAT(instrument_zone_, __LINE__) = Instrument::Register(name); \
+    Instrument::ScopedZone INSTRUMENT_CONCAT(instrument_scope_, __LINE__)(INSTRUMENT_CONCAT(instrument_zone_, __LINE__))
+#else
+#define INSTRUMENT_ZONE(name) do {} while (0)
+#endif
@@ -0,0 +1,114 @@
+#include "JobPool.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+namespace JobPool
+{
+    struct Job
+    {
+        const std::function<void(int begin, int end)>* fn;
+        int begin;
+        int end;
+        int* remaining; // jobs left in the ParallelFor that pushed this one, guarded by mutex_
+    };
+
+    static std::mutex mutex_;
+    static std::condition_variable work_available_;
+    static std::condition_variable job_finished_;
+    static std::deque<Job> queue_;
+    static std::vector<std::thread> threads_;
+    static bool quit_ = false;
+
+    // Pops and runs one job if there is one. lock is released while the job runs.
+    static bool RunOne(std::unique_lock<std::mutex>& lock)
+    {
+        if (queue_.empty()) {
+            return false;
+        }
+        Job job = queue_.front();
+        queue_.pop_front();
+
+        lock.unlock();
+        (*job.fn)(job.begin, job.end);
+        lock.lock();
+
+        (*job.remaining)--;
+        job_finished_.notify_all();
+        return true;
+    }
+
+    static void WorkerMain()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!quit_) {
+            if (!RunOne(lock)) {
+                work_available_.wait(lock);
+            }
+        }
+    }
+
+    void Init(int thread_count)
+    {
+        if (!threads_.empty()) {
+            return;
+        }
+        if (thread_count <= 0) {
+            thread_count = (int) std::thread::hardware_concurrency() - 1;
+        }
+        quit_ = false;
+        for (int i = 0; i < thread_count; i++) {
+            threads_.emplace_back(WorkerMain);
+        }
+    }
+
+    void Shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            quit_ = true;
+        }
+        work_available_.notify_all();
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+        threads_.clear();
+    }
+
+    int ThreadCount()
+    {
+        return (int) threads_.size();
+    }
+
+    void ParallelFor(int count, int batch_size, const std::function<void(int begin, int end)>& fn)
+    {
+        if (count <= 0) {
+            return;
+        }
+        if (batch_size < 1) {
+            batch_size = 1;
+        }
+        if (threads_.empty() || count <= batch_size) {
+            fn(0, count);
+            return;
+        }
+
+        int remaining = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (int begin = 0; begin < count; begin += batch_size) {
+            int end = begin + batch_size < count ? begin + batch_size : count;
+            queue_.push_back({ &fn, begin, end, &remaining });
+            remaining++;
+        }
+        work_available_.notify_all();
+
+        // Help with the queue until our jobs are done. The jobs we run may belong to another ParallelFor, that's fine.
+        while (remaining > 0) {
+            if (!RunOne(lock)) {
+                job_finished_.wait(lock);
+            }
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <functional>
+
+// Fixed pool of worker threads shared by the whole program. ParallelFor splits an index range into jobs; the calling
+// thread works on them too and returns once all of its jobs are done. Several threads can call ParallelFor at the
+// same time, their jobs share the queue.
+namespace JobPool
+{
+    // thread_count 0 picks one worker per hardware thread, minus the calling thread
+    void Init(int thread_count = 0);
+    // Joins the workers. Must be called before exiting, a joinable std::thread destroyed at exit terminates the program.
+    void Shutdown();
+    int ThreadCount();
+
+    // Calls fn(begin, end) on consecutive sub ranges of [0, count) of at most batch_size items. Runs inline when the
+    // pool has no worker or there is a single batch.
+    void ParallelFor(int count, int batch_size, const std::function<void(int begin, int end)>& fn);
+}
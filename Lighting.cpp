@@ -0,0 +1,299 @@
+#include "Lighting.h"
+#include <string.h>
+#include <vector>
+#include "Map.h"
+#include "Instrument.h"
+
+namespace Lighting
+{
+    int changed_cells_ = 0;
+
+    static constexpr int world_x = Map::max_chunks_x * Chunk::sx;
+    static constexpr int world_y = Map::max_chunks_y * Chunk::sy;
+    static constexpr int world_z = Chunk::sz;
+
+    // light channels, shift of their 4 bits in the light byte
+    static constexpr int sky = 4;
+    static constexpr int block = 0;
+
+    struct Node
+    {
+        uint16_t x;
+        uint16_t y;
+        uint8_t z;
+        uint8_t level; // only used by the removal queue, level the cell had before it was cleared
+    };
+
+    // Both queues are plain vectors read from a head index and reused between updates, so an edit doesn't allocate.
+    static std::vector<Node> add_queue_;
+    static std::vector<Node> remove_queue_;
+
+    static const int dirs[6][3] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+    static constexpr int dir_down = 4;
+
+    static bool InWorld(int x, int y, int z)
+    {
+        return x >= 0 && x < world_x && y >= 0 && y < world_y && z >= 0 && z < world_z;
+    }
+
+    // x, y, z must be in the world
+    static Chunk* ChunkOf(int x, int y)
+    {
+        return Map::chunks[(x / Chunk::sx) + (y / Chunk::sy) * Map::max_chunks_x];
+    }
+
+    static int CellIndex(int x, int y, int z)
+    {
+        return (x % Chunk::sx) + (y % Chunk::sy) * Chunk::sx + z * Chunk::sx * Chunk::sy;
+    }
+
+    static uint8_t GetCell(int x, int y, int z)
+    {
+        return ChunkOf(x, y)->cells[CellIndex(x, y, z)];
+    }
+
+    static int GetLevel(int x, int y, int z, int channel)
+    {
+        return (ChunkOf(x, y)->light[CellIndex(x, y, z)] >> channel) & 15;
+    }
+
+    static void SetLevel(int x, int y, int z, int channel, int level)
+    {
+        Chunk* chunk = ChunkOf(x, y);
+        uint8_t& light = chunk->light[CellIndex(x, y, z)];
+        light = (uint8_t) ((light & ~(15 << channel)) | (level << channel));
+        changed_cells_++;
+
+        // faces are lit by the cell in front of them, which can be meshed by the neighbour chunk
+        chunk->dirty_ = true;
+        int cx = x % Chunk::sx;
+        int cy = y % Chunk::sy;
+        if (cx == 0 && x > 0) ChunkOf(x - 1, y)->dirty_ = true;
+        if (cx == Chunk::sx - 1 && x < world_x - 1) ChunkOf(x + 1, y)->dirty_ = true;
+        if (cy == 0 && y > 0) ChunkOf(x, y - 1)->dirty_ = true;
+        if (cy == Chunk::sy - 1 && y < world_y - 1) ChunkOf(x, y + 1)->dirty_ = true;
+    }
+
+    static void Push(std::vector<Node>& queue, int x, int y, int z, int level)
+    {
+        queue.push_back({ (uint16_t) x, (uint16_t) y, (uint8_t) z, (uint8_t) level });
+    }
+
+    // Full sky light keeps its level going straight down through air, every other step costs one level.
+    static int SpreadLevel(int level, int channel, int dir, uint8_t to_cell)
+    {
+        if (channel == sky && dir == dir_down && level == max_light && to_cell == 0) {
+            return max_light;
+        }
+        return level - 1;
+    }
+
+    static void Propagate(int channel)
+    {
+        for (size_t head = 0; head < add_queue_.size(); head++) {
+            Node node = add_queue_[head];
+            int level = GetLevel(node.x, node.y, node.z, channel);
+            if (level <= 1) {
+                continue;
+            }
+            for (int d = 0; d < 6; d++) {
+                int nx = node.x + dirs[d][0];
+                int ny = node.y + dirs[d][1];
+                int nz = node.z + dirs[d][2];
+                if (!InWorld(nx, ny, nz)) {
+                    continue;
+                }
+                uint8_t cell = GetCell(nx, ny, nz);
+                if (!IsTransparent(cell)) {
+                    continue;
+                }
+                int next = SpreadLevel(level, channel, d, cell);
+                if (GetLevel(nx, ny, nz, channel) >= next) {
+                    continue;
+                }
+                SetLevel(nx, ny, nz, channel, next);
+                Push(add_queue_, nx, ny, nz, next);
+            }
+        }
+        add_queue_.clear();
+    }
+
+    // Clears the light that came from the cells in the removal queue. Neighbours at least as bright as the removed
+    // light are lit by something else, they go to the add queue to fill the hole back in.
+    static void Unpropagate(int channel)
+    {
+        for (size_t head = 0; head < remove_queue_.size(); head++) {
+            Node node = remove_queue_[head];
+            for (int d = 0; d < 6; d++) {
+                int nx = node.x + dirs[d][0];
+                int ny = node.y + dirs[d][1];
+                int nz = node.z + dirs[d][2];
+                if (!InWorld(nx, ny, nz)) {
+                    continue;
+                }
+                int neighbour_level = GetLevel(nx, ny, nz, channel);
+                if (neighbour_level == 0) {
+                    continue;
+                }
+                bool sunlight_below = channel == sky && d == dir_down && node.level == max_light && neighbour_level == max_light;
+                if (neighbour_level < node.level || sunlight_below) {
+                    SetLevel(nx, ny, nz, channel, 0);
+                    Push(remove_queue_, nx, ny, nz, neighbour_level);
+                } else {
+                    Push(add_queue_, nx, ny, nz, neighbour_level);
+                }
+            }
+        }
+        remove_queue_.clear();
+    }
+
+    void ComputeAll()
+    {
+        INSTRUMENT_ZONE("Lighting::ComputeAll");
+        for (int i = 0; i < Map::max_chunks_x * Map::max_chunks_y; i++) {
+            memset(Map::chunks[i]->light, 0, sizeof(Map::chunks[i]->light));
+            Map::chunks[i]->dirty_ = true;
+        }
+
+        // direct sunlight, down every column until the first cell that isn't air
+        for (int y = 0; y < world_y; y++) {
+            for (int x = 0; x < world_x; x++) {
+                Chunk* chunk = ChunkOf(x, y);
+                for (int z = world_z - 1; z >= 0 && chunk->cells[CellIndex(x, y, z)] == 0; z--) {
+                    chunk->light[CellIndex(x, y, z)] = max_light << 4;
+                }
+            }
+        }
+
+        // Only the sunlit cells next to a darker open cell need to spread, which skips most of the open sky.
+        for (int y = 0; y < world_y; y++) {
+            for (int x = 0; x < world_x; x++) {
+                for (int z = world_z - 1; z >= 0 && GetLevel(x, y, z, sky) == max_light; z--) {
+                    for (int d = 0; d < 5; d++) {
+                        int nx = x + dirs[d][0];
+                        int ny = y + dirs[d][1];
+                        int nz = z + dirs[d][2];
+                        if (InWorld(nx, ny, nz) && IsTransparent(GetCell(nx, ny, nz)) && GetLevel(nx, ny, nz, sky) < max_light) {
+                            Push(add_queue_, x, y, z, max_light);
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        Propagate(sky);
+
+        for (int z = 0; z < world_z; z++) {
+            for (int y = 0; y < world_y; y++) {
+                for (int x = 0; x < world_x; x++) {
+                    int emission = Emission(GetCell(x, y, z));
+                    if (emission > 0) {
+                        SetLevel(x, y, z, block, emission);
+                        Push(add_queue_, x, y, z, emission);
+                    }
+                }
+            }
+        }
+        Propagate(block);
+    }
+
+    void LightChunk(Chunk* chunk)
+    {
+        // Direct sunlight only depends on the column, it's final. Filling it in the neighbours too keeps the spread
+        // below from flooding their open sky with lower levels, only for them to be raised again when they're lit.
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                Chunk* neighbour = Map::chunk_at(chunk->chunk_x_ + dx, chunk->chunk_y_ + dy);
+                if (neighbour == nullptr) {
+                    continue;
+                }
+                for (int i = 0; i < Chunk::sx * Chunk::sy; i++) {
+                    for (int index = i + (world_z - 1) * Chunk::sx * Chunk::sy; index >= 0 && neighbour->cells[index] == 0; index -= Chunk::sx * Chunk::sy) {
+                        neighbour->light[index] |= max_light << sky;
+                    }
+                }
+                neighbour->dirty_ = true;
+            }
+        }
+
+        // same seeding as ComputeAll, the dark open cells around the chunk get the light spread into them
+        int start_x = chunk->chunk_x_ * Chunk::sx;
+        int start_y = chunk->chunk_y_ * Chunk::sy;
+        for (int y = start_y; y < start_y + Chunk::sy; y++) {
+            for (int x = start_x; x < start_x + Chunk::sx; x++) {
+                for (int z = world_z - 1; z >= 0 && GetLevel(x, y, z, sky) == max_light; z--) {
+                    for (int d = 0; d < 5; d++) {
+                        int nx = x + dirs[d][0];
+                        int ny = y + dirs[d][1];
+                        int nz = z + dirs[d][2];
+                        if (InWorld(nx, ny, nz) && IsTransparent(GetCell(nx, ny, nz)) && GetLevel(nx, ny, nz, sky) < max_light) {
+                            Push(add_queue_, x, y, z, max_light);
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        Propagate(sky);
+
+        for (int z = 0; z < world_z; z++) {
+            for (int y = start_y; y < start_y + Chunk::sy; y++) {
+                for (int x = start_x; x < start_x + Chunk::sx; x++) {
+                    int emission = Emission(GetCell(x, y, z));
+                    if (emission > GetLevel(x, y, z, block)) {
+                        SetLevel(x, y, z, block, emission);
+                        Push(add_queue_, x, y, z, emission);
+                    }
+                }
+            }
+        }
+        Propagate(block);
+    }
+
+    void SetCell(int x, int y, int z, uint8_t val)
+    {
+        INSTRUMENT_ZONE("Lighting::SetCell");
+        changed_cells_ = 0;
+        if (!InWorld(x, y, z)) {
+            return;
+        }
+        uint8_t old = GetCell(x, y, z);
+        if (old == val) {
+            return;
+        }
+        Map::set_cell_at(x, y, z, val);
+
+        for (int channel : { sky, block }) {
+            int level = GetLevel(x, y, z, channel);
+            bool lost_emission = channel == block && Emission(old) > 0;
+            // water stops direct sunlight, the cell gets lit again by the spread from above
+            bool lost_sunlight = channel == sky && level == max_light && val != 0;
+            if (level > 0 && (!IsTransparent(val) || lost_emission || lost_sunlight)) {
+                SetLevel(x, y, z, channel, 0);
+                Push(remove_queue_, x, y, z, level);
+            }
+            Unpropagate(channel);
+
+            if (channel == block && Emission(val) > 0) {
+                SetLevel(x, y, z, block, Emission(val));
+                Push(add_queue_, x, y, z, Emission(val));
+            }
+            if (IsTransparent(val)) {
+                for (int d = 0; d < 6; d++) {
+                    int nx = x + dirs[d][0];
+                    int ny = y + dirs[d][1];
+                    int nz = z + dirs[d][2];
+                    if (InWorld(nx, ny, nz) && GetLevel(nx, ny, nz, channel) > 0) {
+                        Push(add_queue_, nx, ny, nz, 0);
+                    }
+                }
+                // nothing above the top of the map to spread sunlight in
+                if (channel == sky && z == world_z - 1 && val == 0) {
+                    SetLevel(x, y, z, sky, max_light);
+                    Push(add_queue_, x, y, z, max_light);
+                }
+            }
+            Propagate(channel);
+        }
+    }
+}
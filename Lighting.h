@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+
+class Chunk;
+
+// Sky and block light, flood filled through the map. Each cell stores both in Chunk::light: sky light in the high
+// 4 bits, block light in the low 4. Sky light is 15 straight down from the top of the map through air, and both lose
+// one level per cell when spreading sideways or through water. Solid cells stay dark.
+namespace Lighting
+{
+    constexpr int max_light = 15;
+    constexpr int lamp_light = 14;
+
+    inline int SkyLight(uint8_t light) { return light >> 4; }
+    inline int BlockLight(uint8_t light) { return light & 15; }
+    inline int Brightest(uint8_t light) { return SkyLight(light) > BlockLight(light) ? SkyLight(light) : BlockLight(light); }
+
+    inline bool IsTransparent(uint8_t cell) { return cell == 0 || cell == 3; }
+    inline int Emission(uint8_t cell) { return cell == 4 ? lamp_light : 0; }
+
+    // Lights the whole map from scratch.
+    void ComputeAll();
+    // Adds the sunlight and lamps of one chunk and spreads them, only ever raising the light. Once every chunk went
+    // through it, the map is lit the same as by ComputeAll. The chunks within 2 of it must have their final cells.
+    void LightChunk(Chunk* chunk);
+
+    // Sets a cell and updates the light around it: removes the light it blocks or used to emit, and lets the
+    // neighbours' light back in when it opens. Chunks whose light changed are marked dirty.
+    void SetCell(int x, int y, int z, uint8_t val);
+
+    // cells whose light changed during the last SetCell
+    extern int changed_cells_;
+}
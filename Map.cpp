@@ -1,8 +1,11 @@
 #include "types.h"
 #include "GeometryBuilder.h"
 #include "Map.h"
-#include "Noise.h"
 #include "Chunk.h"
+#include "Instrument.h"
+#include "JobPool.h"
+#include "Generator.h"
+#include <math.h>
 
 namespace Map
 {
@@ -11,6 +14,11 @@ namespace Map
 
     uint8_t cell_at(int x, int y, int z)
     {
+        // integer division rounds towards zero, so -1 would land in chunk 0 without the sign checks
+        if (x < 0 || y < 0) {
+            return 0;
+        }
+
         int chunk_x = x / Chunk::sx;
         int chunk_y = y / Chunk::sy;
 
@@ -31,53 +39,174 @@ namespace Map
         return chunk->cells[cx + cy * Chunk::sx + cz * Chunk::sx * Chunk::sy];
     }
 
-    //void cell_set_at(int x, int y, int z, uint8_t val)
-    //{
-    //    if (x < 0 || x >= chunk_width || y < 0 || y >= chunk_height || z < 0 || z >= chunk_width) {
-    //        //LOG(L"Tried to set a tile out of bounds (%i, %i, %i).", x, y, z);
-    //        return;
-    //    }
-    //    cells[z * chunk_width * chunk_height + y * chunk_width + x] = val;
-    //}
+    Chunk* chunk_at(int chunk_x, int chunk_y)
+    {
+        if (chunk_x < 0 || chunk_x >= max_chunks_x || chunk_y < 0 || chunk_y >= max_chunks_y) {
+            return nullptr;
+        }
+        return chunks[chunk_x + chunk_y * max_chunks_x];
+    }
 
-    void GenerateTerrain()
+    void set_cell_at(int x, int y, int z, uint8_t val)
     {
-        for (int chunk_y = 0; chunk_y < max_chunks_y; chunk_y++) {
-            for (int chunk_x = 0; chunk_x < max_chunks_x; chunk_x++) {
-                chunks[chunk_x + chunk_y * max_chunks_x] = new Chunk(chunk_x, chunk_y);
+        if (x < 0 || y < 0 || z < 0 || z >= Chunk::sz) {
+            return;
+        }
+        Chunk* chunk = chunk_at(x / Chunk::sx, y / Chunk::sy);
+        if (chunk == nullptr) {
+            return;
+        }
+
+        int cx = x % Chunk::sx;
+        int cy = y % Chunk::sy;
+        chunk->SetCellLocal(cx, cy, z, val);
+
+        // the neighbours mesh this cell in their border (face culling, ambient occlusion)
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                bool touches_x = dx == 0 || (dx < 0 ? cx == 0 : cx == Chunk::sx - 1);
+                bool touches_y = dy == 0 || (dy < 0 ? cy == 0 : cy == Chunk::sy - 1);
+                Chunk* neighbour = chunk_at(chunk->chunk_x_ + dx, chunk->chunk_y_ + dy);
+                if (neighbour && touches_x && touches_y) {
+                    neighbour->dirty_ = true;
+                }
             }
         }
+    }
 
-        for (int chunk_y = 0; chunk_y < max_chunks_y; chunk_y++) {
-            for (int chunk_x = 0; chunk_x < max_chunks_x; chunk_x++) {
-                Chunk* chunk = chunks[chunk_x + chunk_y * max_chunks_x];
-                // iterate the chunk's cells
-                for (int z = 0; z < Chunk::sz; z++) {
-                    for (int y = 0; y < Chunk::sy; y++) {
-                        for (int x = 0; x < Chunk::sx; x++) {
-                            int global_x = chunk_x * Chunk::sx + x;
-                            int global_y = chunk_y * Chunk::sy + y;
-
-                            float secondary_noise = +Noise::perlin2d(global_x, global_y, 0.11f, 1);
-                            float perlin = Noise::perlin2d(global_x, global_y, 0.03f, 3) * Chunk::sz;
-                            perlin -= 10;
-                            perlin += secondary_noise * 4;
-                            if (z <= perlin) {
-                                if (z <= perlin - 1) {
-                                    chunk->SetCellLocal(x, y, z, 2);
-                                }
-                                else {
-                                    chunk->SetCellLocal(x, y, z, 1);
-                                }
-                            } else if (z <= 5) {
-                                chunk->SetCellLocal(x, y, z, 3);
-                            }
-                        }
+    void GatherSolidCells(int min_x, int min_y, int min_z, int max_x, int max_y, int max_z, std::vector<SolidCell>* out)
+    {
+        out->clear();
+        constexpr int size_x = max_chunks_x * Chunk::sx;
+        constexpr int size_y = max_chunks_y * Chunk::sy;
+        for (int y = min_y; y <= max_y; y++) {
+            for (int x = min_x; x <= max_x; x++) {
+                bool outside = x < 0 || x >= size_x || y < 0 || y >= size_y;
+                Chunk* chunk = outside ? nullptr : chunks[(x / Chunk::sx) + (y / Chunk::sy) * max_chunks_x];
+                int column = outside ? 0 : (x % Chunk::sx) + (y % Chunk::sy) * Chunk::sx;
+                for (int z = min_z; z <= max_z && z < Chunk::sz; z++) {
+                    uint8_t cell = (outside || z < 0) ? 2 : chunk->cells[column + z * Chunk::sx * Chunk::sy];
+                    if (cell != 0) {
+                        out->push_back({ x, y, z, cell });
                     }
                 }
-                
             }
         }
     }
-}
 
+    RayHit Raycast(vec3_t origin, vec3_t dir, float max_dist)
+    {
+        RayHit result = {};
+        float length = sqrtf(dir.x * dir.x + dir.y * dir.y + dir.z * dir.z);
+        if (length == 0) {
+            return result;
+        }
+        float d[3] = { dir.x / length, dir.y / length, dir.z / length };
+        float o[3] = { origin.x, origin.y, origin.z };
+        const int size[3] = { max_chunks_x * Chunk::sx, max_chunks_y * Chunk::sy, Chunk::sz };
+        // index offset of one cell along each axis in Chunk::cells
+        const int chunk_size[3] = { Chunk::sx, Chunk::sy, Chunk::sz };
+        const int stride[3] = { 1, Chunk::sx, Chunk::sx * Chunk::sy };
+
+        int cell[3];
+        int step[3];
+        // distance along the ray to the next cell boundary on each axis, and between two boundaries
+        float t_max[3];
+        float t_delta[3];
+        for (int axis = 0; axis < 3; axis++) {
+            cell[axis] = (int) floorf(o[axis]);
+            if (d[axis] > 0) {
+                step[axis] = 1;
+                t_max[axis] = (cell[axis] + 1 - o[axis]) / d[axis];
+                t_delta[axis] = 1 / d[axis];
+            } else if (d[axis] < 0) {
+                step[axis] = -1;
+                t_max[axis] = (o[axis] - cell[axis]) / -d[axis];
+                t_delta[axis] = -1 / d[axis];
+            } else {
+                step[axis] = 0;
+                t_max[axis] = INFINITY;
+                t_delta[axis] = INFINITY;
+            }
+        }
+
+        // Cells are read straight from the current chunk. A step moves the index in the chunk, the chunk is only looked
+        // up again when the step leaves it.
+        Chunk* chunk = nullptr;
+        int local[3] = {};
+        int index = 0;
+        auto enter_chunk = [&]() {
+            bool inside = cell[0] >= 0 && cell[0] < size[0] && cell[1] >= 0 && cell[1] < size[1] && cell[2] >= 0 && cell[2] < size[2];
+            if (!inside) {
+                chunk = nullptr;
+                return;
+            }
+            chunk = chunks[(cell[0] / Chunk::sx) + (cell[1] / Chunk::sy) * max_chunks_x];
+            local[0] = cell[0] % Chunk::sx;
+            local[1] = cell[1] % Chunk::sy;
+            local[2] = cell[2];
+            index = local[0] + local[1] * stride[1] + local[2] * stride[2];
+        };
+        enter_chunk();
+
+        int normal_axis = -1;
+        float t = 0;
+        while (t <= max_dist) {
+            if (chunk && chunk->cells[index] != 0) {
+                result.hit = true;
+                result.x = cell[0];
+                result.y = cell[1];
+                result.z = cell[2];
+                if (normal_axis >= 0) {
+                    int* normal[3] = { &result.normal_x, &result.normal_y, &result.normal_z };
+                    *normal[normal_axis] = -step[normal_axis];
+                }
+                result.distance = t;
+                result.cell = chunk->cells[index];
+                return result;
+            }
+
+            int axis = t_max[0] < t_max[1] ? (t_max[0] < t_max[2] ? 0 : 2) : (t_max[1] < t_max[2] ? 1 : 2);
+            t = t_max[axis];
+            t_max[axis] += t_delta[axis];
+            cell[axis] += step[axis];
+            normal_axis = axis;
+
+            // out of the map and going further away, nothing left to hit
+            if ((cell[axis] < 0 && step[axis] < 0) || (cell[axis] >= size[axis] && step[axis] > 0)) {
+                break;
+            }
+
+            local[axis] += step[axis];
+            if (chunk == nullptr || (unsigned) local[axis] >= (unsigned) chunk_size[axis]) {
+                enter_chunk();
+            } else {
+                index += step[axis] * stride[axis];
+            }
+        }
+        return result;
+    }
+
+    void RaycastBatch(const vec3_t* origins, const vec3_t* dirs, int count, float max_dist, RayHit* hits)
+    {
+        INSTRUMENT_ZONE("Map::RaycastBatch");
+        JobPool::ParallelFor(count, 256, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                hits[i] = Raycast(origins[i], dirs[i], max_dist);
+            }
+        });
+    }
+
+    void GenerateTerrain()
+    {
+        INSTRUMENT_ZONE("Map::GenerateTerrain");
+        std::vector<Chunk*> all_chunks;
+        for (int chunk_y = 0; chunk_y < max_chunks_y; chunk_y++) {
+            for (int chunk_x = 0; chunk_x < max_chunks_x; chunk_x++) {
+                chunks[chunk_x + chunk_y * max_chunks_x] = new Chunk(chunk_x, chunk_y);
+                all_chunks.push_back(chunks[chunk_x + chunk_y * max_chunks_x]);
+            }
+        }
+        Generator::Generate(all_chunks, Generator::stage_lighting);
+    }
+}
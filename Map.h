@@ -12,7 +12,38 @@ namespace Map
     extern Chunk* chunks[max_chunks_x * max_chunks_y];
     extern std::vector<Chunk*> free_chunks;
     void Generate(GeometryBuilder* builder);
+    // Creates the chunks and runs every Generator stage on them.
     void GenerateTerrain();
     uint8_t cell_at(int x, int y, int z);
+    // Sets a cell and marks its chunk dirty, and the neighbour chunks touching the cell. Doesn't relight, see Lighting::SetCell.
+    void set_cell_at(int x, int y, int z, uint8_t val);
+    Chunk* chunk_at(int chunk_x, int chunk_y);
+
+    struct SolidCell
+    {
+        int x, y, z;
+        uint8_t cell;
+    };
+
+    // Solid cells of the box from min to max (inclusive, map coordinates) in out, read straight from the chunks. The sides of the
+    // map and under it are reported as stone so nothing walks or falls out of it, above it is empty.
+    void GatherSolidCells(int min_x, int min_y, int min_z, int max_x, int max_y, int max_z, std::vector<SolidCell>* out);
+
+    struct RayHit
+    {
+        bool hit;
+        // cell hit, and the normal of the face the ray entered it through (all 0 when the ray starts inside the cell)
+        int x, y, z;
+        int normal_x, normal_y, normal_z;
+        // along the ray, in cells
+        float distance;
+        uint8_t cell;
+    };
+
+    // First solid cell along the ray, in map coordinates (z up). dir doesn't need to be normalized. Steps cell by
+    // cell through the chunks (Amanatides-Woo), above the map and outside of it counts as empty.
+    RayHit Raycast(vec3_t origin, vec3_t dir, float max_dist);
+    // Raycast for each origin/dir pair, split over the JobPool.
+    void RaycastBatch(const vec3_t* origins, const vec3_t* dirs, int count, float max_dist, RayHit* hits);
 }
 
@@ -1,5 +1,15 @@
 // source: https://gist.github.com/nowl/828013
+#include "Noise.h"
 #include <stdio.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NOISE_AVX2
+#elif defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define NOISE_SSE2
+#endif
 
 namespace Noise {
     static int SEED = 0;
@@ -60,4 +70,393 @@ namespace Noise {
         }
         return fin / div;
     }
+    int noise3(int x, int y, int z)
+    {
+        int tmp = hash[(z + SEED) % 256];
+        tmp = hash[(tmp + y) % 256];
+        return hash[(tmp + x) % 256];
+    }
+    float noise3d(float x, float y, float z)
+    {
+        int x_int = x;
+        int y_int = y;
+        int z_int = z;
+        float x_frac = x - x_int;
+        float y_frac = y - y_int;
+        float z_frac = z - z_int;
+        float low_low = smooth_inter(noise3(x_int, y_int, z_int), noise3(x_int + 1, y_int, z_int), x_frac);
+        float low_high = smooth_inter(noise3(x_int, y_int + 1, z_int), noise3(x_int + 1, y_int + 1, z_int), x_frac);
+        float high_low = smooth_inter(noise3(x_int, y_int, z_int + 1), noise3(x_int + 1, y_int, z_int + 1), x_frac);
+        float high_high = smooth_inter(noise3(x_int, y_int + 1, z_int + 1), noise3(x_int + 1, y_int + 1, z_int + 1), x_frac);
+        float low = smooth_inter(low_low, low_high, y_frac);
+        float high = smooth_inter(high_low, high_high, y_frac);
+        return smooth_inter(low, high, z_frac);
+    }
+    float perlin3d(float x, float y, float z, float freq, int depth)
+    {
+        float xa = x * freq;
+        float ya = y * freq;
+        float za = z * freq;
+        float amp = 1.0;
+        float fin = 0;
+        float div = 0.0;
+        for (int i = 0; i < depth; i++)
+        {
+            div += 256 * amp;
+            fin += noise3d(xa, ya, za) * amp;
+            amp /= 2;
+            xa *= 2;
+            ya *= 2;
+            za *= 2;
+        }
+        return fin / div;
+    }
+
+    // Simplex noise, after Stefan Gustavson's "Simplex noise demystified". Corners are hashed with multiplications
+    // instead of the table so the batch version can do it in registers, the gradient comes from the top 3 bits.
+    static constexpr float f2 = 0.36602540378f; // (sqrt(3) - 1) / 2
+    static constexpr float g2 = 0.21132486540f; // (3 - sqrt(3)) / 6
+    static constexpr float f3 = 1.0f / 3.0f;
+    static constexpr float g3 = 1.0f / 6.0f;
+    static constexpr float scale2 = 45.0f;
+    static constexpr float scale3 = 76.0f;
+    static constexpr uint32_t prime_x = 0x8DA6B343u;
+    static constexpr uint32_t prime_y = 0xD8163841u;
+    static constexpr uint32_t prime_z = 0xCB1AB31Fu;
+    static constexpr uint32_t prime_mix = 0x27D4EB2Du;
+
+    static int fast_floor(float x)
+    {
+        int i = (int) x;
+        return x < i ? i - 1 : i;
+    }
+    static uint32_t hash2(int x, int y)
+    {
+        return (((uint32_t) x * prime_x) ^ ((uint32_t) y * prime_y) ^ (uint32_t) SEED) * prime_mix;
+    }
+    static uint32_t hash3(int x, int y, int z)
+    {
+        return (((uint32_t) x * prime_x) ^ ((uint32_t) y * prime_y) ^ ((uint32_t) z * prime_z) ^ (uint32_t) SEED) * prime_mix;
+    }
+
+    // 8 gradients (+-1, +-2) and (+-2, +-1). Picked with bit operations, branches on random bits mispredict half the time.
+    static void grad2(uint32_t h, float* gx, float* gy)
+    {
+        union { uint32_t u; float f; } a, b;
+        a.f = 1.0f;
+        b.f = 2.0f;
+        a.u ^= (h << 2) & 0x80000000u;
+        b.u ^= (h << 1) & 0x80000000u;
+        float swap = (float) (h >> 31);
+        *gx = b.f + (a.f - b.f) * swap;
+        *gy = a.f + (b.f - a.f) * swap;
+    }
+
+    // the 12 cube edge directions, 4 of them twice to make it 16
+    static const float grad3_table[16][3] = {
+        { 1, 1, 0 }, { -1, 1, 0 }, { 1, -1, 0 }, { -1, -1, 0 },
+        { 1, 0, 1 }, { -1, 0, 1 }, { 1, 0, -1 }, { -1, 0, -1 },
+        { 0, 1, 1 }, { 0, -1, 1 }, { 0, 1, -1 }, { 0, -1, -1 },
+        { 1, 1, 0 }, { -1, 1, 0 }, { 0, -1, 1 }, { 0, -1, -1 } };
+
+    // Contribution of one corner, x and y relative to it: (0.5 - r^2)^4 * dot(gradient, offset). The derivative is
+    // -8 * (0.5 - r^2)^3 * dot * offset + (0.5 - r^2)^4 * gradient.
+    static void corner2(float x, float y, uint32_t h, float* n, float* dx, float* dy)
+    {
+        float t = 0.5f - x * x - y * y;
+        // A corner out of range is clamped to no contribution rather than skipped: there's no branch on which corners
+        // are in range, and it's the same max with 0 the batch does, so both paths give the same values.
+        t = t < 0 ? 0 : t;
+        float gx, gy;
+        grad2(h, &gx, &gy);
+        float t2 = t * t;
+        float t4 = t2 * t2;
+        float dot = gx * x + gy * y;
+        *n += t4 * dot;
+        float k = -8.0f * t2 * t * dot;
+        *dx += k * x + t4 * gx;
+        *dy += k * y + t4 * gy;
+    }
+
+    // Same falloff radius and clamp as in 2d. The usual 0.6 reaches past the simplex and leaves small seams in the
+    // value and the derivatives.
+    static void corner3(float x, float y, float z, uint32_t h, float* n, float* dx, float* dy, float* dz)
+    {
+        float t = 0.5f - x * x - y * y - z * z;
+        t = t < 0 ? 0 : t;
+        const float* g = grad3_table[h >> 28];
+        float t2 = t * t;
+        float t4 = t2 * t2;
+        float dot = g[0] * x + g[1] * y + g[2] * z;
+        *n += t4 * dot;
+        float k = -8.0f * t2 * t * dot;
+        *dx += k * x + t4 * g[0];
+        *dy += k * y + t4 * g[1];
+        *dz += k * z + t4 * g[2];
+    }
+
+    float simplex2d(float x, float y, float* dx, float* dy)
+    {
+        // skew to the grid of squares split in two triangles, find the triangle and unskew its corners back
+        float s = (x + y) * f2;
+        int i = fast_floor(x + s);
+        int j = fast_floor(y + s);
+        float t = (i + j) * g2;
+        float x0 = x - (i - t);
+        float y0 = y - (j - t);
+        int i1 = x0 > y0 ? 1 : 0;
+        int j1 = 1 - i1;
+
+        float n = 0, ddx = 0, ddy = 0;
+        corner2(x0, y0, hash2(i, j), &n, &ddx, &ddy);
+        corner2(x0 - i1 + g2, y0 - j1 + g2, hash2(i + i1, j + j1), &n, &ddx, &ddy);
+        corner2(x0 - 1 + 2 * g2, y0 - 1 + 2 * g2, hash2(i + 1, j + 1), &n, &ddx, &ddy);
+        if (dx) *dx = ddx * scale2;
+        if (dy) *dy = ddy * scale2;
+        return n * scale2;
+    }
+
+    float simplex3d(float x, float y, float z, float* dx, float* dy, float* dz)
+    {
+        float s = (x + y + z) * f3;
+        int i = fast_floor(x + s);
+        int j = fast_floor(y + s);
+        int k = fast_floor(z + s);
+        float t = (i + j + k) * g3;
+        float x0 = x - (i - t);
+        float y0 = y - (j - t);
+        float z0 = z - (k - t);
+
+        // the cube is split in 6 tetrahedra, ordered by which offset is largest
+        int i1, j1, k1, i2, j2, k2;
+        if (x0 >= y0) {
+            if (y0 >= z0)      { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+            else if (x0 >= z0) { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 0; k2 = 1; }
+            else               { i1 = 0; j1 = 0; k1 = 1; i2 = 1; j2 = 0; k2 = 1; }
+        } else {
+            if (y0 < z0)       { i1 = 0; j1 = 0; k1 = 1; i2 = 0; j2 = 1; k2 = 1; }
+            else if (x0 < z0)  { i1 = 0; j1 = 1; k1 = 0; i2 = 0; j2 = 1; k2 = 1; }
+            else               { i1 = 0; j1 = 1; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+        }
+
+        float n = 0, ddx = 0, ddy = 0, ddz = 0;
+        corner3(x0, y0, z0, hash3(i, j, k), &n, &ddx, &ddy, &ddz);
+        corner3(x0 - i1 + g3, y0 - j1 + g3, z0 - k1 + g3, hash3(i + i1, j + j1, k + k1), &n, &ddx, &ddy, &ddz);
+        corner3(x0 - i2 + 2 * g3, y0 - j2 + 2 * g3, z0 - k2 + 2 * g3, hash3(i + i2, j + j2, k + k2), &n, &ddx, &ddy, &ddz);
+        corner3(x0 - 1 + 3 * g3, y0 - 1 + 3 * g3, z0 - 1 + 3 * g3, hash3(i + 1, j + 1, k + 1), &n, &ddx, &ddy, &ddz);
+        if (dx) *dx = ddx * scale3;
+        if (dy) *dy = ddy * scale3;
+        if (dz) *dz = ddz * scale3;
+        return n * scale3;
+    }
+
+    float simplex_fbm2d(float x, float y, float freq, int depth, float* dx, float* dy)
+    {
+        float xa = x * freq;
+        float ya = y * freq;
+        float amp = 1.0f;
+        float fin = 0;
+        float div = 0;
+        float ddx = 0, ddy = 0;
+        for (int i = 0; i < depth; i++) {
+            float ox, oy;
+            div += amp;
+            fin += simplex2d(xa, ya, &ox, &oy) * amp;
+            // d/dx of octave i is its own derivative times its frequency, amp * freq * 2^i = freq
+            ddx += ox * freq;
+            ddy += oy * freq;
+            amp /= 2;
+            xa *= 2;
+            ya *= 2;
+        }
+        // same [0, 1] range as perlin2d
+        if (dx) *dx = ddx * 0.5f / div;
+        if (dy) *dy = ddy * 0.5f / div;
+        return fin * 0.5f / div + 0.5f;
+    }
+
+    float simplex_fbm3d(float x, float y, float z, float freq, int depth)
+    {
+        float xa = x * freq;
+        float ya = y * freq;
+        float za = z * freq;
+        float amp = 1.0f;
+        float fin = 0;
+        float div = 0;
+        for (int i = 0; i < depth; i++) {
+            div += amp;
+            fin += simplex3d(xa, ya, za) * amp;
+            amp /= 2;
+            xa *= 2;
+            ya *= 2;
+            za *= 2;
+        }
+        return fin * 0.5f / div + 0.5f;
+    }
+
+#if defined(NOISE_AVX2)
+    static __m256i hash2_avx2(__m256i x, __m256i y)
+    {
+        __m256i h = _mm256_xor_si256(_mm256_mullo_epi32(x, _mm256_set1_epi32((int) prime_x)), _mm256_mullo_epi32(y, _mm256_set1_epi32((int) prime_y)));
+        h = _mm256_xor_si256(h, _mm256_set1_epi32(SEED));
+        return _mm256_mullo_epi32(h, _mm256_set1_epi32((int) prime_mix));
+    }
+
+    static void corner2_avx2(__m256 x, __m256 y, __m256i h, __m256* n, __m256* dx, __m256* dy)
+    {
+        __m256 sign = _mm256_castsi256_ps(_mm256_set1_epi32((int) 0x80000000u));
+        __m256 a = _mm256_xor_ps(_mm256_set1_ps(1.0f), _mm256_and_ps(_mm256_castsi256_ps(_mm256_slli_epi32(h, 2)), sign));
+        __m256 b = _mm256_xor_ps(_mm256_set1_ps(2.0f), _mm256_and_ps(_mm256_castsi256_ps(_mm256_slli_epi32(h, 1)), sign));
+        __m256 swap = _mm256_castsi256_ps(_mm256_srai_epi32(h, 31));
+        __m256 gx = _mm256_blendv_ps(b, a, swap);
+        __m256 gy = _mm256_blendv_ps(a, b, swap);
+
+        __m256 t = _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(x, x)), _mm256_mul_ps(y, y));
+        t = _mm256_max_ps(t, _mm256_setzero_ps());
+        __m256 t2 = _mm256_mul_ps(t, t);
+        __m256 t4 = _mm256_mul_ps(t2, t2);
+        __m256 dot = _mm256_add_ps(_mm256_mul_ps(gx, x), _mm256_mul_ps(gy, y));
+        *n = _mm256_add_ps(*n, _mm256_mul_ps(t4, dot));
+        __m256 k = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(-8.0f), t2), t), dot);
+        *dx = _mm256_add_ps(*dx, _mm256_add_ps(_mm256_mul_ps(k, x), _mm256_mul_ps(t4, gx)));
+        *dy = _mm256_add_ps(*dy, _mm256_add_ps(_mm256_mul_ps(k, y), _mm256_mul_ps(t4, gy)));
+    }
+#elif defined(NOISE_SSE2)
+    // no 32 bit multiply before sse4.1, the even and odd lanes go through the 64 bit one
+    static __m128i mullo_sse2(__m128i a, __m128i b)
+    {
+        __m128i even = _mm_mul_epu32(a, b);
+        __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    }
+
+    static __m128i floor_sse2(__m128 x)
+    {
+        __m128i i = _mm_cvttps_epi32(x);
+        // truncation rounds negative values up, take one off where it did
+        return _mm_add_epi32(i, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(i), x)));
+    }
+
+    static __m128 select_sse2(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    static __m128i hash2_sse2(__m128i x, __m128i y)
+    {
+        __m128i h = _mm_xor_si128(mullo_sse2(x, _mm_set1_epi32((int) prime_x)), mullo_sse2(y, _mm_set1_epi32((int) prime_y)));
+        h = _mm_xor_si128(h, _mm_set1_epi32(SEED));
+        return mullo_sse2(h, _mm_set1_epi32((int) prime_mix));
+    }
+
+    static void corner2_sse2(__m128 x, __m128 y, __m128i h, __m128* n, __m128* dx, __m128* dy)
+    {
+        __m128 sign = _mm_castsi128_ps(_mm_set1_epi32((int) 0x80000000u));
+        __m128 a = _mm_xor_ps(_mm_set1_ps(1.0f), _mm_and_ps(_mm_castsi128_ps(_mm_slli_epi32(h, 2)), sign));
+        __m128 b = _mm_xor_ps(_mm_set1_ps(2.0f), _mm_and_ps(_mm_castsi128_ps(_mm_slli_epi32(h, 1)), sign));
+        __m128 swap = _mm_castsi128_ps(_mm_srai_epi32(h, 31));
+        __m128 gx = select_sse2(swap, a, b);
+        __m128 gy = select_sse2(swap, b, a);
+
+        __m128 t = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(0.5f), _mm_mul_ps(x, x)), _mm_mul_ps(y, y));
+        t = _mm_max_ps(t, _mm_setzero_ps());
+        __m128 t2 = _mm_mul_ps(t, t);
+        __m128 t4 = _mm_mul_ps(t2, t2);
+        __m128 dot = _mm_add_ps(_mm_mul_ps(gx, x), _mm_mul_ps(gy, y));
+        *n = _mm_add_ps(*n, _mm_mul_ps(t4, dot));
+        __m128 k = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(-8.0f), t2), t), dot);
+        *dx = _mm_add_ps(*dx, _mm_add_ps(_mm_mul_ps(k, x), _mm_mul_ps(t4, gx)));
+        *dy = _mm_add_ps(*dy, _mm_add_ps(_mm_mul_ps(k, y), _mm_mul_ps(t4, gy)));
+    }
+#endif
+
+    const char* SimdPathName()
+    {
+#if defined(NOISE_AVX2)
+        return "avx2";
+#elif defined(NOISE_SSE2)
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    void simplex2d_batch(const float* x, const float* y, int count, float* out, float* dx, float* dy)
+    {
+        int i = 0;
+#if defined(NOISE_AVX2)
+        for (; i + 8 <= count; i += 8) {
+            __m256 px = _mm256_loadu_ps(&x[i]);
+            __m256 py = _mm256_loadu_ps(&y[i]);
+            __m256 s = _mm256_mul_ps(_mm256_add_ps(px, py), _mm256_set1_ps(f2));
+            __m256 fi = _mm256_floor_ps(_mm256_add_ps(px, s));
+            __m256 fj = _mm256_floor_ps(_mm256_add_ps(py, s));
+            __m256i ci = _mm256_cvttps_epi32(fi);
+            __m256i cj = _mm256_cvttps_epi32(fj);
+            __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(ci, cj)), _mm256_set1_ps(g2));
+            __m256 x0 = _mm256_sub_ps(px, _mm256_sub_ps(_mm256_cvtepi32_ps(ci), t));
+            __m256 y0 = _mm256_sub_ps(py, _mm256_sub_ps(_mm256_cvtepi32_ps(cj), t));
+            // all ones in the lanes where the middle corner is along x
+            __m256 along_x = _mm256_cmp_ps(x0, y0, _CMP_GT_OQ);
+            __m256 one = _mm256_set1_ps(1.0f);
+            __m256 i1 = _mm256_and_ps(along_x, one);
+            __m256 j1 = _mm256_andnot_ps(along_x, one);
+            __m256i step_i = _mm256_srli_epi32(_mm256_castps_si256(along_x), 31);
+            __m256i step_j = _mm256_sub_epi32(_mm256_set1_epi32(1), step_i);
+
+            __m256 n = _mm256_setzero_ps();
+            __m256 ddx = _mm256_setzero_ps();
+            __m256 ddy = _mm256_setzero_ps();
+            __m256 g = _mm256_set1_ps(g2);
+            __m256 last = _mm256_set1_ps(-1 + 2 * g2);
+            corner2_avx2(x0, y0, hash2_avx2(ci, cj), &n, &ddx, &ddy);
+            corner2_avx2(_mm256_add_ps(_mm256_sub_ps(x0, i1), g), _mm256_add_ps(_mm256_sub_ps(y0, j1), g),
+                hash2_avx2(_mm256_add_epi32(ci, step_i), _mm256_add_epi32(cj, step_j)), &n, &ddx, &ddy);
+            corner2_avx2(_mm256_add_ps(x0, last), _mm256_add_ps(y0, last),
+                hash2_avx2(_mm256_add_epi32(ci, _mm256_set1_epi32(1)), _mm256_add_epi32(cj, _mm256_set1_epi32(1))), &n, &ddx, &ddy);
+
+            __m256 scale = _mm256_set1_ps(scale2);
+            _mm256_storeu_ps(&out[i], _mm256_mul_ps(n, scale));
+            if (dx) _mm256_storeu_ps(&dx[i], _mm256_mul_ps(ddx, scale));
+            if (dy) _mm256_storeu_ps(&dy[i], _mm256_mul_ps(ddy, scale));
+        }
+#elif defined(NOISE_SSE2)
+        for (; i + 4 <= count; i += 4) {
+            __m128 px = _mm_loadu_ps(&x[i]);
+            __m128 py = _mm_loadu_ps(&y[i]);
+            __m128 s = _mm_mul_ps(_mm_add_ps(px, py), _mm_set1_ps(f2));
+            __m128i ci = floor_sse2(_mm_add_ps(px, s));
+            __m128i cj = floor_sse2(_mm_add_ps(py, s));
+            __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(ci, cj)), _mm_set1_ps(g2));
+            __m128 x0 = _mm_sub_ps(px, _mm_sub_ps(_mm_cvtepi32_ps(ci), t));
+            __m128 y0 = _mm_sub_ps(py, _mm_sub_ps(_mm_cvtepi32_ps(cj), t));
+            // all ones in the lanes where the middle corner is along x
+            __m128 along_x = _mm_cmpgt_ps(x0, y0);
+            __m128 one = _mm_set1_ps(1.0f);
+            __m128 i1 = _mm_and_ps(along_x, one);
+            __m128 j1 = _mm_andnot_ps(along_x, one);
+            __m128i step_i = _mm_srli_epi32(_mm_castps_si128(along_x), 31);
+            __m128i step_j = _mm_sub_epi32(_mm_set1_epi32(1), step_i);
+
+            __m128 n = _mm_setzero_ps();
+            __m128 ddx = _mm_setzero_ps();
+            __m128 ddy = _mm_setzero_ps();
+            __m128 g = _mm_set1_ps(g2);
+            __m128 last = _mm_set1_ps(-1 + 2 * g2);
+            corner2_sse2(x0, y0, hash2_sse2(ci, cj), &n, &ddx, &ddy);
+            corner2_sse2(_mm_add_ps(_mm_sub_ps(x0, i1), g), _mm_add_ps(_mm_sub_ps(y0, j1), g),
+                hash2_sse2(_mm_add_epi32(ci, step_i), _mm_add_epi32(cj, step_j)), &n, &ddx, &ddy);
+            corner2_sse2(_mm_add_ps(x0, last), _mm_add_ps(y0, last),
+                hash2_sse2(_mm_add_epi32(ci, _mm_set1_epi32(1)), _mm_add_epi32(cj, _mm_set1_epi32(1))), &n, &ddx, &ddy);
+
+            __m128 scale = _mm_set1_ps(scale2);
+            _mm_storeu_ps(&out[i], _mm_mul_ps(n, scale));
+            if (dx) _mm_storeu_ps(&dx[i], _mm_mul_ps(ddx, scale));
+            if (dy) _mm_storeu_ps(&dy[i], _mm_mul_ps(ddy, scale));
+        }
+#endif
+        for (; i < count; i++) {
+            out[i] = simplex2d(x[i], y[i], dx ? &dx[i] : nullptr, dy ? &dy[i] : nullptr);
+        }
+    }
 }
@@ -6,4 +6,19 @@ namespace Noise {
     float smooth_inter(float x, float y, float s);
     float noise2d(float x, float y);
     float perlin2d(float x, float y, float freq, int depth);
+    // same as the 2d versions, with a third axis
+    int noise3(int x, int y, int z);
+    float noise3d(float x, float y, float z);
+    float perlin3d(float x, float y, float z, float freq, int depth);
+
+    // Simplex gradient noise in [-1, 1], without the grid aligned blocks of the value noise above. When dx, dy
+    // (and dz) are given they get the analytic derivative of the result.
+    float simplex2d(float x, float y, float* dx = nullptr, float* dy = nullptr);
+    float simplex3d(float x, float y, float z, float* dx = nullptr, float* dy = nullptr, float* dz = nullptr);
+    // octaves of simplex noise in [0, 1], drop in replacements for perlin2d / perlin3d
+    float simplex_fbm2d(float x, float y, float freq, int depth, float* dx = nullptr, float* dy = nullptr);
+    float simplex_fbm3d(float x, float y, float z, float freq, int depth);
+    // simplex2d for count points, 8 or 4 at a time depending on the SIMD path. dx and dy can be null.
+    void simplex2d_batch(const float* x, const float* y, int count, float* out, float* dx = nullptr, float* dy = nullptr);
+    const char* SimdPathName();
 }
@@ -0,0 +1,154 @@
+#include "NoiseCache.h"
+#include <assert.h>
+#include <string.h>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include "Noise.h"
+#include "Instrument.h"
+
+namespace NoiseCache
+{
+    struct Key
+    {
+        int tile_x;
+        int tile_y;
+        int step;
+        uint32_t freq_bits;
+        int depth;
+
+        bool operator==(const Key& other) const
+        {
+            return tile_x == other.tile_x && tile_y == other.tile_y && step == other.step && freq_bits == other.freq_bits && depth == other.depth;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            uint64_t h = (uint32_t) key.tile_x * 0x9E3779B1u;
+            h ^= (uint64_t) ((uint32_t) key.tile_y * 0x85EBCA77u) << 32;
+            h ^= (uint64_t) key.freq_bits * 0xC2B2AE3D27D4EB4Full;
+            h ^= (uint64_t) (key.step * 31 + key.depth);
+            return (size_t) h;
+        }
+    };
+
+    // most recently used at the front, the map points into the list so a hit moves its tile to the front in place
+    typedef std::list<std::pair<Key, std::shared_ptr<const Tile>>> TileList;
+    static std::mutex mutex_;
+    static TileList lru_;
+    static std::unordered_map<Key, TileList::iterator, KeyHash> tiles_;
+    static int capacity_ = default_capacity;
+    static Stats stats_;
+
+    float Tile::At(int x, int y) const
+    {
+        int local_x = x - tile_x * tile_size;
+        int local_y = y - tile_y * tile_size;
+        assert(local_x % step == 0 && local_y % step == 0);
+        return values[(local_y / step) * samples_per_side + local_x / step];
+    }
+
+    static void Evict()
+    {
+        while ((int) lru_.size() > capacity_) {
+            tiles_.erase(lru_.back().first);
+            lru_.pop_back();
+            stats_.evictions++;
+        }
+    }
+
+    static Tile* ComputeTile(const Key& key, float freq)
+    {
+        INSTRUMENT_ZONE("NoiseCache::ComputeTile");
+        Tile* tile = new Tile();
+        tile->tile_x = key.tile_x;
+        tile->tile_y = key.tile_y;
+        tile->step = key.step;
+        tile->freq = freq;
+        tile->depth = key.depth;
+        tile->samples_per_side = tile_size / key.step + 1;
+        tile->values.resize(tile->samples_per_side * tile->samples_per_side);
+        for (int sample_y = 0; sample_y < tile->samples_per_side; sample_y++) {
+            for (int sample_x = 0; sample_x < tile->samples_per_side; sample_x++) {
+                int x = key.tile_x * tile_size + sample_x * key.step;
+                int y = key.tile_y * tile_size + sample_y * key.step;
+                tile->values[sample_y * tile->samples_per_side + sample_x] = Noise::perlin2d(x, y, freq, key.depth);
+            }
+        }
+        return tile;
+    }
+
+    std::shared_ptr<const Tile> TileAt(int x, int y, int step, float freq, int depth)
+    {
+        assert(step > 0 && tile_size % step == 0);
+        Key key;
+        // floor division, so negative columns land in their own tiles
+        key.tile_x = x >= 0 ? x / tile_size : (x + 1) / tile_size - 1;
+        key.tile_y = y >= 0 ? y / tile_size : (y + 1) / tile_size - 1;
+        key.step = step;
+        memcpy(&key.freq_bits, &freq, sizeof(freq));
+        key.depth = depth;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = tiles_.find(key);
+            if (found != tiles_.end()) {
+                stats_.hits++;
+                lru_.splice(lru_.begin(), lru_, found->second);
+                return found->second->second;
+            }
+            stats_.misses++;
+        }
+
+        // Computed outside the lock so the other threads keep hitting meanwhile. Two threads missing the same tile
+        // both compute it, the second one uses the tile the first put in.
+        std::shared_ptr<const Tile> tile(ComputeTile(key, freq));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = tiles_.find(key);
+        if (found != tiles_.end()) {
+            lru_.splice(lru_.begin(), lru_, found->second);
+            return found->second->second;
+        }
+        lru_.emplace_front(key, tile);
+        tiles_[key] = lru_.begin();
+        Evict();
+        return tile;
+    }
+
+    void SetCapacity(int tiles)
+    {
+        assert(tiles > 0);
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_ = tiles;
+        Evict();
+    }
+
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tiles_.clear();
+        lru_.clear();
+    }
+
+    Stats GetStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Stats stats = stats_;
+        stats.tiles = (int) lru_.size();
+        stats.bytes = 0;
+        for (const auto& entry : lru_) {
+            stats.bytes += sizeof(Tile) + sizeof(float) * entry.second->values.size();
+        }
+        return stats;
+    }
+
+    void ResetStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_ = Stats();
+    }
+}
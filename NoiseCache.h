@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+// Tiles of Noise::perlin2d sums over map columns, kept in an LRU so the chunks of a tile, and the same chunks generated
+// again while streaming, don't redo the octaves. A tile covers tile_size columns on each side at one sample step,
+// frequency and depth, the values are exactly what perlin2d returns at those columns.
+namespace NoiseCache
+{
+    // a multiple of the chunk size so a chunk is always in a single tile
+    constexpr int tile_size = 64;
+    constexpr int default_capacity = 256;
+
+    struct Tile
+    {
+        int tile_x;
+        int tile_y;
+        int step;
+        float freq;
+        int depth;
+        int samples_per_side;
+        // samples_per_side * samples_per_side values, the last row and column are the first of the next tile
+        std::vector<float> values;
+
+        // value at a map column of the tile, x and y on the sample grid
+        float At(int x, int y) const;
+    };
+
+    // Tile containing the map column, computed if it's not in the cache. Thread safe; a tile evicted while it's still
+    // used stays alive until the last reference goes.
+    std::shared_ptr<const Tile> TileAt(int x, int y, int step, float freq, int depth);
+
+    // max tiles kept, the least recently used ones go first
+    void SetCapacity(int tiles);
+    void Clear();
+
+    struct Stats
+    {
+        int64_t hits;
+        int64_t misses;
+        int64_t evictions;
+        int tiles;
+        int64_t bytes;
+    };
+    Stats GetStats();
+    void ResetStats();
+}
@@ -0,0 +1,80 @@
+#include "ParticleManager.h"
+#include "JobPool.h"
+#include "Instrument.h"
+
+ParticleManager::~ParticleManager()
+{
+    for (ParticleSystem* system : systems_) {
+        delete system;
+    }
+}
+
+ParticleSystem* ParticleManager::Add(ParticleSystem* system)
+{
+    systems_.push_back(system);
+    return system;
+}
+
+int ParticleManager::ParticleCount() const
+{
+    int count = 0;
+    for (ParticleSystem* system : systems_) {
+        count += system->Count();
+    }
+    return count;
+}
+
+// one job per batch_size_ particles of each system
+void ParticleManager::BuildJobs()
+{
+    jobs_.clear();
+    for (ParticleSystem* system : systems_) {
+        for (int begin = 0; begin < system->Count(); begin += batch_size_) {
+            int end = begin + batch_size_ < system->Count() ? begin + batch_size_ : system->Count();
+            jobs_.push_back({ system, begin, end });
+        }
+    }
+}
+
+void ParticleManager::Simulate(float delta_time)
+{
+    INSTRUMENT_ZONE("ParticleManager::Simulate");
+    delta_time_ = delta_time;
+    // every system has its own random stream, so they can all spawn in parallel
+    JobPool::ParallelFor((int) systems_.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            systems_[i]->Emit(delta_time);
+        }
+    });
+
+    BuildJobs();
+    JobPool::ParallelFor((int) jobs_.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            jobs_[i].system->Simulate(jobs_[i].begin, jobs_[i].end, delta_time);
+            jobs_[i].system->Collide(jobs_[i].begin, jobs_[i].end);
+        }
+    });
+
+    // compaction moves particles across job boundaries, so it runs per system
+    JobPool::ParallelFor((int) systems_.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            systems_[i]->Compact();
+        }
+    });
+}
+
+void ParticleManager::FillInstances(float alpha)
+{
+    INSTRUMENT_ZONE("ParticleManager::FillInstances");
+    for (ParticleSystem* system : systems_) {
+        system->instances_.resize(system->Count());
+    }
+
+    float rewind = (1.0f - alpha) * delta_time_;
+    BuildJobs();
+    JobPool::ParallelFor((int) jobs_.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            jobs_[i].system->FillInstances(jobs_[i].begin, jobs_[i].end, rewind);
+        }
+    });
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <vector>
+#include "ParticleSystem.h"
+
+// Owns all the particle systems. Simulation of every system runs on the JobPool, big systems being split in several
+// jobs. Drawing them is up to a ParticleRenderer, from the instance data.
+class ParticleManager
+{
+	struct SimulateJob
+	{
+		ParticleSystem* system;
+		int begin;
+		int end;
+	};
+	std::vector<SimulateJob> jobs_;
+	// of the last Simulate
+	float delta_time_ = 0;
+
+	void BuildJobs();
+
+	public:
+	std::vector<ParticleSystem*> systems_;
+	// max particles per simulation job
+	int batch_size_ = 16384;
+
+	~ParticleManager();
+	// takes ownership of system
+	ParticleSystem* Add(ParticleSystem* system);
+	int ParticleCount() const;
+	// Emits, simulates and compacts every system. Touches no D3D object.
+	void Simulate(float delta_time);
+	// Writes the instance data of every system, alpha of the way from the state before the last Simulate to the one
+	// after it, see Game::Update.
+	void FillInstances(float alpha);
+};
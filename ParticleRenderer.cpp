@@ -0,0 +1,48 @@
+#include "ParticleRenderer.h"
+#include <string.h>
+
+void ParticleRenderer::Init(ID3D11Device* device, const ParticleManager& particles)
+{
+    for (ParticleSystem* system : particles.systems_) {
+        D3D11_BUFFER_DESC desc = {
+            .ByteWidth = static_cast<UINT>(system->max_particles_ * sizeof(ParticleInstance)),
+            .Usage = D3D11_USAGE_DYNAMIC,
+            .BindFlags = D3D11_BIND_VERTEX_BUFFER,
+            .CPUAccessFlags = D3D10_CPU_ACCESS_WRITE,
+        };
+
+        ID3D11Buffer* buffer = nullptr;
+        device->CreateBuffer(&desc, nullptr, &buffer);
+        instance_buffers_.push_back(buffer);
+    }
+}
+
+void ParticleRenderer::Upload(ID3D11DeviceContext* context, const std::vector<std::vector<ParticleInstance>>& instances)
+{
+    for (size_t i = 0; i < instance_buffers_.size() && i < instances.size(); i++) {
+        if (instances[i].empty()) {
+            continue;
+        }
+
+        D3D11_MAPPED_SUBRESOURCE mapped_resource = {};
+        context->Map(instance_buffers_[i], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
+        memcpy(mapped_resource.pData, instances[i].data(), instances[i].size() * sizeof(ParticleInstance));
+        context->Unmap(instance_buffers_[i], 0);
+    }
+}
+
+void ParticleRenderer::Render(ID3D11DeviceContext* context, const std::vector<std::vector<ParticleInstance>>& instances)
+{
+    UINT stride = sizeof(ParticleInstance);
+    UINT offset = 0;
+    for (size_t i = 0; i < instance_buffers_.size() && i < instances.size(); i++) {
+        if (instances[i].empty()) {
+            continue;
+        }
+
+        context->IASetVertexBuffers(0, 1, &instance_buffers_[i], &stride, &offset);
+
+        // draw, 6 vertices (two triangles) per particle
+        context->DrawInstanced(6, (UINT) instances[i].size(), 0, 0);
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <vector>
+#include <d3d11.h>
+#include "ParticleManager.h"
+
+// GPU side of the particle systems: one dynamic instance buffer per system, filled from the instance arrays of a
+// FramePacket. Belongs to the render thread, the systems themselves don't touch D3D.
+class ParticleRenderer
+{
+	public:
+	std::vector<ID3D11Buffer*> instance_buffers_;
+
+	// One buffer per system of particles, in systems_ order, each sized for the system's max_particles_.
+	void Init(ID3D11Device* device, const ParticleManager& particles);
+	// one instance array per system, in ParticleManager::systems_ order, see FramePacket
+	void Upload(ID3D11DeviceContext* context, const std::vector<std::vector<ParticleInstance>>& instances);
+	// Draws the instances of the matching Upload. Expects the particle shader and input layout to be bound, the quads
+	// are oriented with the camera vectors of the constant buffer.
+	void Render(ID3D11DeviceContext* context, const std::vector<std::vector<ParticleInstance>>& instances);
+};
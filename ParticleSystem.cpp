@@ -1,189 +1,316 @@
 #include "ParticleSystem.h"
+#include <math.h>
+#include "Map.h"
+#include "Instrument.h"
 
-static uint32_t random_next_seed(uint32_t* state)
-{
-    //uint32_t t = *state;
-    *state ^= *state << 13;
-    *state ^= *state >> 17;
-    *state ^= *state << 5;
-    //return t;
-    return *state;
-}
-
-// Range is min inclusive and max exclusive. Eveness of distribution untested, TODO. Formula taken from here: https://www.geeksforgeeks.org/generating-random-number-range-c/
-uint32_t rdx_random_in_range(uint32_t* seed, int32_t min, int32_t max)
-{
-    //std::assert(min <= max);
-    uint32_t range = (uint32_t)(max - min);
-    uint32_t rand = random_next_seed(seed);
-    return (rand % range) + min;
-}
-
-float rdx_rand_range_f(uint32_t* seed, float min, float max)
-{
-    random_next_seed(seed);
-    double r = ((double)*seed) / UINT32_MAX;
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PARTICLES_AVX2
+#elif defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PARTICLES_SSE2
+#endif
 
-    return r * (max - min) + min;
-}
-
-ParticleSystem::ParticleSystem(ID3D11Device* device, int max_particles)
+ParticleSystem::ParticleSystem(int max_particles, uint32_t seed)
+    : random_(seed)
 {
     max_particles_ = max_particles;
     spawn_rate_ = 0.1f;
     lifetime_ = 5.0f;
 
-	positions_.reserve(max_particles);
-	velocities_.reserve(max_particles);
-    lifetimes_.reserve(max_particles);
-    rotations_2d_.reserve(max_particles);
+    position_x_.resize(max_particles);
+    position_y_.resize(max_particles);
+    position_z_.resize(max_particles);
+    velocity_x_.resize(max_particles);
+    velocity_y_.resize(max_particles);
+    velocity_z_.resize(max_particles);
+    lifetimes_.resize(max_particles);
+    rotations_2d_.resize(max_particles);
+    rotations_2d_over_time_.resize(max_particles);
+    instances_.reserve(max_particles);
+}
 
-    {
-        D3D11_BUFFER_DESC desc = {
-            .ByteWidth = static_cast<UINT>(max_particles * 4 * sizeof(builder_.vert[0])),
-            .Usage = D3D11_USAGE_DYNAMIC,
-            .BindFlags = D3D11_BIND_VERTEX_BUFFER,
-            .CPUAccessFlags = D3D10_CPU_ACCESS_WRITE,
-        };
-
-        device->CreateBuffer(&desc, nullptr, &vbuffer_);
+// Writes count new particles at the end of the arrays, one array at a time
+void ParticleSystem::Spawn(int count)
+{
+    // a negative count would shrink count_ and lose live particles
+    if (count <= 0) {
+        return;
+    }
+    int first = count_;
+    int end = first + count;
+    if (end > max_particles_) {
+        end = max_particles_;
     }
+    count_ = end;
+    count = end - first;
 
-    {
-        D3D11_BUFFER_DESC desc = {
-            .ByteWidth = static_cast<UINT>(max_particles * 6 * sizeof(builder_.ind[0])),
-            .Usage = D3D11_USAGE_DYNAMIC,
-            .BindFlags = D3D11_BIND_INDEX_BUFFER,
-            .CPUAccessFlags = D3D10_CPU_ACCESS_WRITE,
-        };
-
-        D3D11_SUBRESOURCE_DATA initial = { .pSysMem = builder_.ind.data() };
-        device->CreateBuffer(&desc, nullptr, &ibuffer_);
+    random_.FillRange(&position_x_[first], count, pos_.x - spawn_volume_size_.x, pos_.x + spawn_volume_size_.x);
+    random_.FillRange(&position_y_[first], count, pos_.y - spawn_volume_size_.y, pos_.y + spawn_volume_size_.y);
+    random_.FillRange(&position_z_[first], count, pos_.z - spawn_volume_size_.z, pos_.z + spawn_volume_size_.z);
+    random_.FillRange(&velocity_x_[first], count, -10, 10);
+    random_.FillRange(&velocity_y_[first], count, -10, 10);
+    random_.FillRange(&velocity_z_[first], count, -10, 10);
+    for (int i = first; i < end; i++) {
+        lifetimes_[i] = lifetime_;
     }
+    random_.FillRange(&rotations_2d_[first], count, 0, 3.14f * 2);
+    random_.FillRange(&rotations_2d_over_time_[first], count, -10, 10);
+}
+
+void ParticleSystem::Burst(int count)
+{
+    Spawn(count);
 }
 
-void ParticleSystem::Spawn()
+void ParticleSystem::Emit(float delta_time)
 {
-    if (positions_.size() >= max_particles_ - 1) {
-        printf("Can't spawn new particle, max_particles count reached!\n");
+    INSTRUMENT_ZONE("ParticleSystem::Emit");
+    if (spawn_rate_ <= 0.0f) {
         return;
     }
+    spawn_budget_ += delta_time / spawn_rate_;
+    int count = (int) spawn_budget_;
+    spawn_budget_ -= count;
+    if (count > 0) {
+        Spawn(count);
+    }
+}
 
-    static uint32_t seed = 42;
+const char* ParticleSystem::SimdPathName()
+{
+#if defined(PARTICLES_AVX2)
+    return "avx2";
+#elif defined(PARTICLES_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
 
-    vec3_t position = pos_;
-    position.x += rdx_rand_range_f(&seed, -spawn_volume_size_.x, spawn_volume_size_.x);
-    position.y += rdx_rand_range_f(&seed, -spawn_volume_size_.y, spawn_volume_size_.y);
-    position.z += rdx_rand_range_f(&seed, -spawn_volume_size_.z, spawn_volume_size_.z);
-	positions_.push_back(position);
+void ParticleSystem::SimulateScalar(int begin, int end, float delta_time)
+{
+    float target_x = target_velocity_.x * 0.1f;
+    float target_y = target_velocity_.y * 0.1f;
+    float target_z = target_velocity_.z * 0.1f;
+    float min_x = pos_.x - spawn_volume_size_.x;
+    float max_x = pos_.x + spawn_volume_size_.x;
+    float min_z = pos_.z - spawn_volume_size_.z;
+    float max_z = pos_.z + spawn_volume_size_.z;
+    float width_x = spawn_volume_size_.x * 2;
+    float width_z = spawn_volume_size_.z * 2;
 
-    vec3_t vel = vec3(rdx_rand_range_f(&seed, -0.5f, 0.5f), rdx_rand_range_f(&seed, -0.5f, 0.5f), rdx_rand_range_f(&seed, -0.5f, 0.5f));
-    velocities_.push_back(vel * 20);
+    for (int i = begin; i < end; i++) {
+        velocity_x_[i] = velocity_x_[i] * 0.9f + target_x;
+        velocity_y_[i] = velocity_y_[i] * 0.9f + target_y;
+        velocity_z_[i] = velocity_z_[i] * 0.9f + target_z;
 
-    lifetimes_.push_back(lifetime_);
+        float x = position_x_[i] + velocity_x_[i] * delta_time;
+        float z = position_z_[i] + velocity_z_[i] * delta_time;
+        position_y_[i] += velocity_y_[i] * delta_time;
 
-    rotations_2d_.push_back(rdx_rand_range_f(&seed, 0, 3.14f * 2));
+        // Teleport particles that are outside of the allowed zone
+        if (x > max_x) x -= width_x;
+        if (x < min_x) x += width_x;
+        if (z > max_z) z -= width_z;
+        if (z < min_z) z += width_z;
+        position_x_[i] = x;
+        position_z_[i] = z;
 
-    rotations_2d_over_time_.push_back(rdx_rand_range_f(&seed, -10, 10));
+        lifetimes_[i] -= delta_time;
+    }
 }
 
-
-void ParticleSystem::UpdateAndRender(ID3D11DeviceContext* context, float delta_time, vec3_t camera_forward)
+void ParticleSystem::Simulate(int begin, int end, float delta_time)
 {
-    // Spawn new particles
-    if (next_spawn_timer_ <= 0.0f) {
-        Spawn();
-        next_spawn_timer_ = spawn_rate_;
-    }
-    next_spawn_timer_ -= delta_time;
+    INSTRUMENT_ZONE("ParticleSystem::Simulate");
+    int i = begin;
+
+#if defined(PARTICLES_AVX2)
+    {
+        __m256 damping = _mm256_set1_ps(0.9f);
+        __m256 target_x = _mm256_set1_ps(target_velocity_.x * 0.1f);
+        __m256 target_y = _mm256_set1_ps(target_velocity_.y * 0.1f);
+        __m256 target_z = _mm256_set1_ps(target_velocity_.z * 0.1f);
+        __m256 min_x = _mm256_set1_ps(pos_.x - spawn_volume_size_.x);
+        __m256 max_x = _mm256_set1_ps(pos_.x + spawn_volume_size_.x);
+        __m256 min_z = _mm256_set1_ps(pos_.z - spawn_volume_size_.z);
+        __m256 max_z = _mm256_set1_ps(pos_.z + spawn_volume_size_.z);
+        __m256 width_x = _mm256_set1_ps(spawn_volume_size_.x * 2);
+        __m256 width_z = _mm256_set1_ps(spawn_volume_size_.z * 2);
+        __m256 dt = _mm256_set1_ps(delta_time);
+
+        for (; i + 8 <= end; i += 8) {
+            __m256 vx = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&velocity_x_[i]), damping), target_x);
+            __m256 vy = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&velocity_y_[i]), damping), target_y);
+            __m256 vz = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&velocity_z_[i]), damping), target_z);
+            __m256 x = _mm256_add_ps(_mm256_loadu_ps(&position_x_[i]), _mm256_mul_ps(vx, dt));
+            __m256 y = _mm256_add_ps(_mm256_loadu_ps(&position_y_[i]), _mm256_mul_ps(vy, dt));
+            __m256 z = _mm256_add_ps(_mm256_loadu_ps(&position_z_[i]), _mm256_mul_ps(vz, dt));
 
-    // Update the particles simulation
-    for (int i = 0; i < positions_.size(); i++) {
-        velocities_[i] = velocities_[i] * 0.9f + target_velocity_ * 0.1f;
-        positions_[i] = positions_[i] + velocities_[i] * delta_time;
+            // wrap with masks instead of branches: subtract/add the width only in the lanes that are out
+            x = _mm256_sub_ps(x, _mm256_and_ps(_mm256_cmp_ps(x, max_x, _CMP_GT_OQ), width_x));
+            x = _mm256_add_ps(x, _mm256_and_ps(_mm256_cmp_ps(x, min_x, _CMP_LT_OQ), width_x));
+            z = _mm256_sub_ps(z, _mm256_and_ps(_mm256_cmp_ps(z, max_z, _CMP_GT_OQ), width_z));
+            z = _mm256_add_ps(z, _mm256_and_ps(_mm256_cmp_ps(z, min_z, _CMP_LT_OQ), width_z));
+
+            _mm256_storeu_ps(&velocity_x_[i], vx);
+            _mm256_storeu_ps(&velocity_y_[i], vy);
+            _mm256_storeu_ps(&velocity_z_[i], vz);
+            _mm256_storeu_ps(&position_x_[i], x);
+            _mm256_storeu_ps(&position_y_[i], y);
+            _mm256_storeu_ps(&position_z_[i], z);
+            _mm256_storeu_ps(&lifetimes_[i], _mm256_sub_ps(_mm256_loadu_ps(&lifetimes_[i]), dt));
+        }
     }
+#elif defined(PARTICLES_SSE2)
+    {
+        __m128 damping = _mm_set1_ps(0.9f);
+        __m128 target_x = _mm_set1_ps(target_velocity_.x * 0.1f);
+        __m128 target_y = _mm_set1_ps(target_velocity_.y * 0.1f);
+        __m128 target_z = _mm_set1_ps(target_velocity_.z * 0.1f);
+        __m128 min_x = _mm_set1_ps(pos_.x - spawn_volume_size_.x);
+        __m128 max_x = _mm_set1_ps(pos_.x + spawn_volume_size_.x);
+        __m128 min_z = _mm_set1_ps(pos_.z - spawn_volume_size_.z);
+        __m128 max_z = _mm_set1_ps(pos_.z + spawn_volume_size_.z);
+        __m128 width_x = _mm_set1_ps(spawn_volume_size_.x * 2);
+        __m128 width_z = _mm_set1_ps(spawn_volume_size_.z * 2);
+        __m128 dt = _mm_set1_ps(delta_time);
 
-    // Delete old particles
-    for (int i = 0; i < positions_.size(); i++) {
-        lifetimes_[i] -= delta_time;
-        if (lifetimes_[i] <= 0) {
-            // delete the particle by "swap and pop" 
-            lifetimes_[i] = lifetimes_[lifetimes_.size()-1];
-            lifetimes_.pop_back();
-            positions_[i] = positions_[positions_.size() - 1];
-            positions_.pop_back();
-            velocities_[i] = velocities_[velocities_.size() - 1];
-            velocities_.pop_back();
-            rotations_2d_[i] = rotations_2d_[rotations_2d_.size() - 1];
-            rotations_2d_.pop_back();
-            rotations_2d_over_time_[i] = rotations_2d_over_time_[rotations_2d_over_time_.size() - 1];
-            rotations_2d_over_time_.pop_back();
+        for (; i + 4 <= end; i += 4) {
+            __m128 vx = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&velocity_x_[i]), damping), target_x);
+            __m128 vy = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&velocity_y_[i]), damping), target_y);
+            __m128 vz = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&velocity_z_[i]), damping), target_z);
+            __m128 x = _mm_add_ps(_mm_loadu_ps(&position_x_[i]), _mm_mul_ps(vx, dt));
+            __m128 y = _mm_add_ps(_mm_loadu_ps(&position_y_[i]), _mm_mul_ps(vy, dt));
+            __m128 z = _mm_add_ps(_mm_loadu_ps(&position_z_[i]), _mm_mul_ps(vz, dt));
+
+            // wrap with masks instead of branches: subtract/add the width only in the lanes that are out
+            x = _mm_sub_ps(x, _mm_and_ps(_mm_cmpgt_ps(x, max_x), width_x));
+            x = _mm_add_ps(x, _mm_and_ps(_mm_cmplt_ps(x, min_x), width_x));
+            z = _mm_sub_ps(z, _mm_and_ps(_mm_cmpgt_ps(z, max_z), width_z));
+            z = _mm_add_ps(z, _mm_and_ps(_mm_cmplt_ps(z, min_z), width_z));
+
+            _mm_storeu_ps(&velocity_x_[i], vx);
+            _mm_storeu_ps(&velocity_y_[i], vy);
+            _mm_storeu_ps(&velocity_z_[i], vz);
+            _mm_storeu_ps(&position_x_[i], x);
+            _mm_storeu_ps(&position_y_[i], y);
+            _mm_storeu_ps(&position_z_[i], z);
+            _mm_storeu_ps(&lifetimes_[i], _mm_sub_ps(_mm_loadu_ps(&lifetimes_[i]), dt));
         }
     }
+#endif
+
+    SimulateScalar(i, end, delta_time);
+}
+
+void ParticleSystem::Collide(int begin, int end)
+{
+    INSTRUMENT_ZONE("ParticleSystem::Collide");
+    if (collision_ == Collision::None || begin >= end) {
+        return;
+    }
 
-    // Teleport particles that are outside of the allowed zone
-    for (int i = 0; i < positions_.size(); i++) {
-        if (positions_[i].x > pos_.x + spawn_volume_size_.x) {
-            positions_[i].x -= spawn_volume_size_.x * 2;
+    constexpr float map_size_x = Map::max_chunks_x * Chunk::sx;
+    constexpr float map_size_y = Map::max_chunks_y * Chunk::sy;
+
+    // Reads the chunk cells directly, without the checks of Map::cell_at. Sorting the particles by chunk first was
+    // measured slower at every size: an emitter only covers a few chunks, which stay in cache anyway.
+    for (int i = begin; i < end; i++) {
+        // convert to map cells (dx11 Y up -> map Z up), particles outside of the map never collide
+        float x = position_x_[i];
+        float y = position_z_[i];
+        float z = position_y_[i];
+        if (!(x >= 0 && y >= 0 && z >= 0 && x < map_size_x && y < map_size_y && z < Chunk::sz)) {
+            continue;
         }
-        if (positions_[i].x < pos_.x - spawn_volume_size_.x) {
-            positions_[i].x += spawn_volume_size_.x * 2;
+        // positive, truncating is flooring
+        int cell_x = (int) x;
+        int cell_y = (int) y;
+        int cell_z = (int) z;
+        const Chunk* chunk = Map::chunks[cell_x / Chunk::sx + (cell_y / Chunk::sy) * Map::max_chunks_x];
+        if (chunk->cells[cell_x % Chunk::sx + (cell_y % Chunk::sy) * Chunk::sx + cell_z * Chunk::sx * Chunk::sy] == 0) {
+            continue;
         }
-        if (positions_[i].z > pos_.z + spawn_volume_size_.z) {
-            positions_[i].z -= spawn_volume_size_.z * 2;
+
+        if (collision_ == Collision::Kill) {
+            lifetimes_[i] = 0.0f;
         }
-        if (positions_[i].z < pos_.z -spawn_volume_size_.z) {
-            positions_[i].z += spawn_volume_size_.z * 2;
+        else {
+            // put it back on top of the cell it fell in and send it up
+            position_y_[i] = (float) (cell_z + 1);
+            if (velocity_y_[i] < 0) {
+                velocity_y_[i] = -velocity_y_[i] * restitution_;
+            }
         }
     }
+}
 
-    // Generate the mesh
-    builder_.vert.clear();
-    builder_.ind.clear();
-    vec3_t up = vec3(0, 1, 0);
-    vec3_t forward = camera_forward * -1;
-    vec3_t right = vec3_dot(up, forward);
-
-	for (int i = 0; i < positions_.size(); i++) {
-        float t = lifetimes_[i] / lifetime_;
-        float particle_size = 1.0f - ((t*2 - 1.f) * (t*2 - 1.f));
-        particle_size *= .3f;
-		vec3_t center = positions_[i];
-        float r = rotations_2d_[i];
-        r += t * rotations_2d_over_time_[i];
-        vec3_t local_x = (right * cos(r) + up * -sin(r)) * particle_size;
-        vec3_t local_y = (right * sin(r) + up * cos(r)) * particle_size;
-
-        vec3_t a = center - local_x - local_y;
-        vec3_t b = center - local_x + local_y;
-        vec3_t c = center + local_x + local_y;
-        vec3_t d = center + local_x - local_y;
-        float col = 1;
-        float opacity = t;
-		builder_.PushQuad(a,b,c,d,vec3(1,1,1),t);
-	}
-
-    // Update vertex buffer
-    {
-        D3D11_MAPPED_SUBRESOURCE mapped_resource = {};
-        context->Map(vbuffer_, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
-        memcpy(mapped_resource.pData, builder_.vert.data(), builder_.vert.size() * sizeof(builder_.vert[0]));
-        context->Unmap(vbuffer_, 0);
+void ParticleSystem::Compact()
+{
+    INSTRUMENT_ZONE("ParticleSystem::Compact");
+    // Live particles before the first dead one stay where they are
+    int i = 0;
+    while (i < count_ && lifetimes_[i] > 0) {
+        i++;
     }
 
-    // Update index buffer
-    {
-        D3D11_MAPPED_SUBRESOURCE mapped_resource = {};
-        context->Map(ibuffer_, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
-        memcpy(mapped_resource.pData, builder_.ind.data(), builder_.ind.size() * sizeof(builder_.ind[0]));
-        context->Unmap(ibuffer_, 0);
+    // Stream compaction: every particle is copied to the write cursor, which only advances past the live ones. No
+    // branch per particle, and each array is swept once however many particles die this frame.
+    int write = i;
+    auto move_to_write = [&](int from, bool alive) {
+        position_x_[write] = position_x_[from];
+        position_y_[write] = position_y_[from];
+        position_z_[write] = position_z_[from];
+        velocity_x_[write] = velocity_x_[from];
+        velocity_y_[write] = velocity_y_[from];
+        velocity_z_[write] = velocity_z_[from];
+        lifetimes_[write] = lifetimes_[from];
+        rotations_2d_[write] = rotations_2d_[from];
+        rotations_2d_over_time_[write] = rotations_2d_over_time_[from];
+        write += alive;
+    };
+
+#if defined(PARTICLES_AVX2) || defined(PARTICLES_SSE2)
+    // Test lifetimes a block at a time, fully dead blocks (bursts of particles spawned together) are skipped at once
+#if defined(PARTICLES_AVX2)
+    constexpr int block = 8;
+#else
+    constexpr int block = 4;
+#endif
+    for (; i + block <= count_; i += block) {
+#if defined(PARTICLES_AVX2)
+        int alive_mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(&lifetimes_[i]), _mm256_setzero_ps(), _CMP_GT_OQ));
+#else
+        int alive_mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(&lifetimes_[i]), _mm_setzero_ps()));
+#endif
+        if (alive_mask == 0) {
+            continue;
+        }
+        for (int lane = 0; lane < block; lane++) {
+            move_to_write(i + lane, (alive_mask >> lane) & 1);
+        }
     }
+#endif
 
-    UINT stride = sizeof(struct Vertex);
-    UINT offset = 0;
-    context->IASetVertexBuffers(0, 1, &vbuffer_, &stride, &offset);
-    context->IASetIndexBuffer(ibuffer_, DXGI_FORMAT_R32_UINT, 0);
+    for (; i < count_; i++) {
+        move_to_write(i, lifetimes_[i] > 0);
+    }
 
-    // draw
-    context->DrawIndexed(builder_.ind.size(), 0, 0);
+    count_ = write;
+}
+
+void ParticleSystem::FillInstances(int begin, int end, float rewind)
+{
+    for (int i = begin; i < end; i++) {
+        float lifetime = lifetimes_[i] + rewind;
+        float t = lifetime < lifetime_ ? lifetime / lifetime_ : 1.0f;
+        ParticleInstance& instance = instances_[i];
+        instance.position[0] = position_x_[i] - velocity_x_[i] * rewind;
+        instance.position[1] = position_y_[i] - velocity_y_[i] * rewind;
+        instance.position[2] = position_z_[i] - velocity_z_[i] * rewind;
+        instance.rotation = rotations_2d_[i] + t * rotations_2d_over_time_[i];
+        instance.age = t;
+    }
 }
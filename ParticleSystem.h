@@ -1,33 +1,74 @@
 #pragma once
 #include <vector>
-#include <d3d11.h>
 #include "types.h"
-#include "GeometryBuilder.h"
+#include "Random.h"
+
+// Per particle data read by the particle vertex shader, which expands every instance into a camera facing quad.
+struct ParticleInstance {
+	float position[3];
+	float rotation;
+	float age; // 1 at spawn, 0 at death
+};
 
 class ParticleSystem
 {
-	std::vector<vec3_t> positions_;
-	std::vector<vec3_t> velocities_;
+	// Particle state as structure of arrays, one float per component so the simulation can run 4 or 8 particles at a
+	// time. Arrays are sized to max_particles_ up front, the first count_ entries are the live particles.
+	std::vector<float> position_x_;
+	std::vector<float> position_y_;
+	std::vector<float> position_z_;
+	std::vector<float> velocity_x_;
+	std::vector<float> velocity_y_;
+	std::vector<float> velocity_z_;
 	std::vector<float> lifetimes_;
 	std::vector<float> rotations_2d_;
 	std::vector<float> rotations_2d_over_time_;
+	int count_ = 0;
+
+	// per system random stream, so systems don't disturb each other and can spawn on any thread
+	Random random_;
 
-	float next_spawn_timer_;
+	// particles owed by the spawn rate, the fractional part carries over to the next update
+	float spawn_budget_ = 1.0f;
+
+	void Spawn(int count);
 
 	public:
-	ID3D11Buffer* vbuffer_;
-	ID3D11Buffer* ibuffer_;
-	GeometryBuilder builder_;
+	// what happens to particles entering a solid map cell
+	enum class Collision { None, Kill, Bounce };
+
+	std::vector<ParticleInstance> instances_;
 	int max_particles_;
-	float spawn_rate_;
-	vec3_t pos_;
-	vec3_t target_velocity_;
-	vec3_t spawn_volume_size_;
+	float spawn_rate_; // seconds between two spawns
+	vec3_t pos_ = {};
+	vec3_t target_velocity_ = {};
+	vec3_t spawn_volume_size_ = {};
 	float lifetime_;
+	Collision collision_ = Collision::None;
+	// fraction of the vertical speed kept when bouncing
+	float restitution_ = 0.4f;
 
-	ParticleSystem(ID3D11Device* device, int max_particles);
-	void Spawn();
-	void UpdateAndRender(ID3D11DeviceContext* context, float delta_time, vec3_t camera_forward);
+	// Two systems with the same seed spawn the same particles. The GPU side is a ParticleRenderer.
+	ParticleSystem(int max_particles, uint32_t seed = 42);
+	int Count() const { return count_; }
+	// Spawns count particles right away, on top of the ones emitted by the spawn rate. Particles that don't fit in
+	// max_particles_ are dropped.
+	void Burst(int count);
+	// Spawns the particles due for delta_time at spawn_rate_, however many that is.
+	void Emit(float delta_time);
+	// Integrates velocity and position, ages and wraps the particles [begin, end) around the spawn volume in a single
+	// pass. Uses AVX2 or SSE2 when the build targets them, SimulateScalar otherwise and for the remainder.
+	void Simulate(int begin, int end, float delta_time);
+	void SimulateScalar(int begin, int end, float delta_time);
+	static const char* SimdPathName();
+	// Tests particles [begin, end) against the terrain and kills or bounces the ones inside a solid cell.
+	void Collide(int begin, int end);
+	// Removes the expired particles, keeping the order of the others.
+	void Compact();
+	// Writes the shader data of particles [begin, end) into instances_, which must hold Count() entries, as they were
+	// rewind seconds before the end of the last Simulate. Positions are integrated with the new velocity, so going back
+	// along it lands on the previous step, only the particles wrapped, bounced or spawned by the last one are off.
+	void FillInstances(int begin, int end, float rewind);
 };
 
 
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <mutex>
+#include "Profiler.h"
+#include "Timer.h"
+
+namespace Profiler
+{
+    const char* zone_names[zone_count] = {
+        "input",
+        "remesh",
+        "chunk_render",
+        "particle_simulate",
+        "particle_upload",
+        "present",
+    };
+
+    static vec3_t zone_colors[zone_count] = {
+        vec3(0.9f, 0.9f, 0.2f),
+        vec3(0.9f, 0.4f, 0.1f),
+        vec3(0.2f, 0.8f, 0.2f),
+        vec3(0.2f, 0.6f, 0.9f),
+        vec3(0.6f, 0.3f, 0.9f),
+        vec3(0.5f, 0.5f, 0.5f),
+    };
+
+    static Frame frames_[history_size];
+    static int frame_count_ = 0;
+    static Frame current_;
+    // zones can be measured on the game and the render threads, they go to the frame the game thread is on
+    static std::mutex mutex_;
+    static thread_local double zone_begin_ms_[zone_count];
+    static uint64_t origin_ = Timer::Now();
+
+    static double NowMs()
+    {
+        return Timer::ToMs(Timer::Now() - origin_);
+    }
+
+    void BeginFrame()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        current_ = {};
+        current_.start_ms = NowMs();
+    }
+
+    void EndFrame()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        current_.duration_ms = NowMs() - current_.start_ms;
+        frames_[frame_count_ % history_size] = current_;
+        frame_count_++;
+    }
+
+    void BeginZone(Zone zone)
+    {
+        zone_begin_ms_[zone] = NowMs();
+    }
+
+    void EndZone(Zone zone)
+    {
+        double now = NowMs();
+        double duration = now - zone_begin_ms_[zone];
+        std::lock_guard<std::mutex> lock(mutex_);
+        current_.zone_ms[zone] += duration;
+        if (current_.event_count < max_events_per_frame) {
+            current_.events[current_.event_count++] = { zone, zone_begin_ms_[zone], duration };
+        }
+    }
+
+    int FrameCount()
+    {
+        return frame_count_ < history_size ? frame_count_ : history_size;
+    }
+
+    // frames in the history, oldest first
+    static const Frame& HistoryFrame(int i)
+    {
+        int first = frame_count_ < history_size ? 0 : frame_count_ - history_size;
+        return frames_[(first + i) % history_size];
+    }
+
+    Stats GetStats(int zone)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Stats stats = {};
+        int count = FrameCount();
+        if (count == 0) {
+            return stats;
+        }
+
+        std::vector<double> times(count);
+        for (int i = 0; i < count; i++) {
+            const Frame& frame = HistoryFrame(i);
+            times[i] = zone == zone_count ? frame.duration_ms : frame.zone_ms[zone];
+        }
+        std::sort(times.begin(), times.end());
+
+        double total = 0;
+        for (double time : times) {
+            total += time;
+        }
+        stats.min_ms = times[0];
+        stats.avg_ms = total / count;
+        stats.p99_ms = times[(count * 99 + 99) / 100 - 1];
+        return stats;
+    }
+
+    void BuildOverlay(GeometryBuilder* builder, float screen_width, float screen_height)
+    {
+        constexpr float margin = 10.0f;
+        float bar_width = fminf(3.0f, (screen_width - 2 * margin) / history_size);
+        float pixels_per_ms = fminf(6.0f, screen_height * 0.5f / 33.3f);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        int count = FrameCount();
+        for (int i = 0; i < count; i++) {
+            const Frame& frame = HistoryFrame(i);
+            float x = margin + i * bar_width;
+            float y = margin;
+
+            // the whole frame behind, the zones stacked on top of it
+            float frame_height = (float) frame.duration_ms * pixels_per_ms;
+            builder->PushQuad(vec3(x, y, 0), vec3(x, y + frame_height, 0), vec3(x + bar_width, y + frame_height, 0), vec3(x + bar_width, y, 0), vec3(0.15f, 0.15f, 0.15f), 0.6f);
+            for (int zone = 0; zone < zone_count; zone++) {
+                float height = (float) frame.zone_ms[zone] * pixels_per_ms;
+                builder->PushQuad(vec3(x, y, 0), vec3(x, y + height, 0), vec3(x + bar_width, y + height, 0), vec3(x + bar_width, y, 0), zone_colors[zone]);
+                y += height;
+            }
+        }
+
+        float budget_y = margin + 16.6f * pixels_per_ms;
+        float right = margin + history_size * bar_width;
+        builder->PushQuad(vec3(margin, budget_y, 0), vec3(margin, budget_y + 1, 0), vec3(right, budget_y + 1, 0), vec3(right, budget_y, 0), vec3(0, 0, 0));
+    }
+
+    bool ExportCsv(const char* path)
+    {
+        FILE* file = fopen(path, "w");
+        if (file == nullptr) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        fprintf(file, "frame,start_ms,frame_ms");
+        for (int zone = 0; zone < zone_count; zone++) {
+            fprintf(file, ",%s_ms", zone_names[zone]);
+        }
+        fprintf(file, "\n");
+
+        int count = FrameCount();
+        for (int i = 0; i < count; i++) {
+            const Frame& frame = HistoryFrame(i);
+            fprintf(file, "%d,%.4f,%.4f", i, frame.start_ms, frame.duration_ms);
+            for (int zone = 0; zone < zone_count; zone++) {
+                fprintf(file, ",%.4f", frame.zone_ms[zone]);
+            }
+            fprintf(file, "\n");
+        }
+
+        fclose(file);
+        return true;
+    }
+
+    bool ExportChromeTrace(const char* path)
+    {
+        FILE* file = fopen(path, "w");
+        if (file == nullptr) {
+            return false;
+        }
+
+        // complete events ("X"), timestamps in microseconds
+        std::lock_guard<std::mutex> lock(mutex_);
+        fprintf(file, "{\"traceEvents\":[\n");
+        bool first = true;
+        int count = FrameCount();
+        for (int i = 0; i < count; i++) {
+            const Frame& frame = HistoryFrame(i);
+            fprintf(file, "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n", frame.start_ms * 1000, frame.duration_ms * 1000);
+            first = false;
+            for (int e = 0; e < frame.event_count; e++) {
+                const Event& event = frame.events[e];
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}", zone_names[event.zone], event.start_ms * 1000, event.duration_ms * 1000);
+            }
+        }
+        fprintf(file, "\n]}\n");
+
+        fclose(file);
+        return true;
+    }
+}
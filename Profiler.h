@@ -0,0 +1,71 @@
+#pragma once
+#include "GeometryBuilder.h"
+
+// Frame timings split by subsystem. Zones measured with Profiler::Scope are accumulated into the current frame, and
+// EndFrame pushes the frame into a ring buffer read by the stats, the overlay and the exports.
+namespace Profiler
+{
+    enum Zone
+    {
+        zone_input,
+        zone_remesh,
+        zone_chunk_render,
+        zone_particle_simulate,
+        zone_particle_upload,
+        zone_present,
+        zone_count,
+    };
+    extern const char* zone_names[zone_count];
+
+    constexpr int history_size = 256;
+    constexpr int max_events_per_frame = 64;
+
+    struct Event
+    {
+        Zone zone;
+        double start_ms; // since the profiler started
+        double duration_ms;
+    };
+
+    struct Frame
+    {
+        double start_ms;
+        double duration_ms;
+        double zone_ms[zone_count];
+        Event events[max_events_per_frame];
+        int event_count;
+    };
+
+    struct Stats
+    {
+        double min_ms;
+        double avg_ms;
+        double p99_ms;
+    };
+
+    void BeginFrame();
+    void EndFrame();
+    void BeginZone(Zone zone);
+    void EndZone(Zone zone);
+
+    struct Scope
+    {
+        Zone zone_;
+        Scope(Zone zone) : zone_(zone) { BeginZone(zone); }
+        ~Scope() { EndZone(zone_); }
+    };
+
+    // over the frames in the history, zone_count for the whole frame
+    Stats GetStats(int zone);
+    int FrameCount();
+
+    // Stacked bars of the zone times, one per frame of the history, in pixels from the bottom left corner of the
+    // screen. The dark line marks 16.6ms. Bars get thinner and shorter on small windows so the graph fits the width
+    // and 33ms fits half the height.
+    void BuildOverlay(GeometryBuilder* builder, float screen_width, float screen_height);
+
+    // one line per frame of the history, times in ms
+    bool ExportCsv(const char* path);
+    // chrome://tracing (or ui.perfetto.dev) json of the events in the history
+    bool ExportChromeTrace(const char* path);
+}
@@ -0,0 +1,113 @@
+#include "Random.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RANDOM_AVX2
+#elif defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define RANDOM_SSE2
+#endif
+
+static uint32_t xorshift32(uint32_t x)
+{
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+// 23 random bits in the mantissa of a float in [1, 2), minus 1
+static float to_unit_float(uint32_t x)
+{
+    union { uint32_t u; float f; } bits;
+    bits.u = (x >> 9) | 0x3F800000u;
+    return bits.f - 1.0f;
+}
+
+Random::Random(uint32_t seed)
+{
+    Seed(seed);
+}
+
+void Random::Seed(uint32_t seed)
+{
+    // decorrelate the lanes with a hash of the seed, xorshift must never start at 0
+    for (int i = 0; i < 8; i++) {
+        uint32_t h = seed + 0x9E3779B9u * (i + 1);
+        h = (h ^ (h >> 16)) * 0x85EBCA6Bu;
+        h = (h ^ (h >> 13)) * 0xC2B2AE35u;
+        h ^= h >> 16;
+        lanes_[i] = h != 0 ? h : 1;
+    }
+}
+
+uint32_t Random::Next()
+{
+    lanes_[0] = xorshift32(lanes_[0]);
+    return lanes_[0];
+}
+
+float Random::NextFloat()
+{
+    return to_unit_float(Next());
+}
+
+float Random::Range(float min, float max)
+{
+    return min + NextFloat() * (max - min);
+}
+
+void Random::FillRange(float* out, int count, float min, float max)
+{
+    float scale = max - min;
+    int i = 0;
+
+#if defined(RANDOM_AVX2)
+    {
+        __m256i state = _mm256_loadu_si256((const __m256i*) lanes_);
+        __m256i exponent = _mm256_set1_epi32(0x3F800000);
+        __m256 one = _mm256_set1_ps(1.0f);
+        __m256 v_min = _mm256_set1_ps(min);
+        __m256 v_scale = _mm256_set1_ps(scale);
+        for (; i + 8 <= count; i += 8) {
+            state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 13));
+            state = _mm256_xor_si256(state, _mm256_srli_epi32(state, 17));
+            state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 5));
+            __m256 unit = _mm256_sub_ps(_mm256_castsi256_ps(_mm256_or_si256(_mm256_srli_epi32(state, 9), exponent)), one);
+            _mm256_storeu_ps(out + i, _mm256_add_ps(v_min, _mm256_mul_ps(unit, v_scale)));
+        }
+        _mm256_storeu_si256((__m256i*) lanes_, state);
+    }
+#elif defined(RANDOM_SSE2)
+    {
+        // lanes 0-3 and 4-7 as two registers, stored in lane order
+        __m128i state_low = _mm_loadu_si128((const __m128i*) lanes_);
+        __m128i state_high = _mm_loadu_si128((const __m128i*) (lanes_ + 4));
+        __m128i exponent = _mm_set1_epi32(0x3F800000);
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 v_min = _mm_set1_ps(min);
+        __m128 v_scale = _mm_set1_ps(scale);
+        for (; i + 8 <= count; i += 8) {
+            state_low = _mm_xor_si128(state_low, _mm_slli_epi32(state_low, 13));
+            state_low = _mm_xor_si128(state_low, _mm_srli_epi32(state_low, 17));
+            state_low = _mm_xor_si128(state_low, _mm_slli_epi32(state_low, 5));
+            state_high = _mm_xor_si128(state_high, _mm_slli_epi32(state_high, 13));
+            state_high = _mm_xor_si128(state_high, _mm_srli_epi32(state_high, 17));
+            state_high = _mm_xor_si128(state_high, _mm_slli_epi32(state_high, 5));
+            __m128 unit_low = _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(state_low, 9), exponent)), one);
+            __m128 unit_high = _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(state_high, 9), exponent)), one);
+            _mm_storeu_ps(out + i, _mm_add_ps(v_min, _mm_mul_ps(unit_low, v_scale)));
+            _mm_storeu_ps(out + i + 4, _mm_add_ps(v_min, _mm_mul_ps(unit_high, v_scale)));
+        }
+        _mm_storeu_si128((__m128i*) lanes_, state_low);
+        _mm_storeu_si128((__m128i*) (lanes_ + 4), state_high);
+    }
+#endif
+
+    // scalar: whole steps of 8 lanes when there is no simd, then the remainder on the first lanes
+    for (; i < count; i++) {
+        int lane = i & 7;
+        lanes_[lane] = xorshift32(lanes_[lane]);
+        out[i] = min + to_unit_float(lanes_[lane]) * scale;
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdint.h>
+
+// Random stream made of 8 xorshift32 generators. FillRange advances the 8 lanes together, 8 at a time with AVX2 or 4
+// with SSE2. The scalar fallback walks the lanes in the same order, so a seed gives the same numbers on every build.
+// One Random per user (particle system, thread...), nothing is shared.
+struct Random
+{
+    uint32_t lanes_[8];
+
+    explicit Random(uint32_t seed = 42);
+    void Seed(uint32_t seed);
+
+    // single values, from the first lane
+    uint32_t Next();
+    float NextFloat(); // [0, 1)
+    float Range(float min, float max);
+
+    // Fills out[0, count) with uniform floats in [min, max)
+    void FillRange(float* out, int count, float min, float max);
+};
@@ -0,0 +1,76 @@
+#include "RenderRegion.h"
+#include <assert.h>
+#include "Instrument.h"
+
+RenderRegion::RenderRegion(int region_x, int region_y)
+{
+    region_x_ = region_x;
+    region_y_ = region_y;
+}
+
+int RenderRegion::SlotOf(int chunk_x, int chunk_y)
+{
+    return (chunk_x % chunks_x) + (chunk_y % chunks_y) * chunks_x;
+}
+
+// Takes the chunk mesh by swapping it with the previous one, the caller gets the old buffers back to reuse their capacity.
+void RenderRegion::SetChunkMesh(int chunk_x, int chunk_y, GeometryBuilder* mesh)
+{
+    assert(chunk_x / chunks_x == region_x_ && chunk_y / chunks_y == region_y_);
+    int slot = SlotOf(chunk_x, chunk_y);
+    meshes_[slot].vert.swap(mesh->vert);
+    meshes_[slot].ind.swap(mesh->ind);
+    dirty_ = true;
+}
+
+void RenderRegion::LayoutChunks()
+{
+    INSTRUMENT_ZONE("RenderRegion::LayoutChunks");
+    dirty_ = false;
+
+    // Concatenate the chunk meshes. Indices are rebased to the region vertex buffer so consecutive chunks form one
+    // contiguous index range and can be drawn together.
+    staging_.vert.clear();
+    staging_.ind.clear();
+    for (int slot = 0; slot < chunk_count; slot++) {
+        uint32_t base_vertex = (uint32_t) staging_.vert.size();
+        first_index_[slot] = (uint32_t) staging_.ind.size();
+        index_count_[slot] = (uint32_t) meshes_[slot].ind.size();
+        staging_.vert.insert(staging_.vert.end(), meshes_[slot].vert.begin(), meshes_[slot].vert.end());
+        for (uint32_t index : meshes_[slot].ind) {
+            staging_.ind.push_back(index + base_vertex);
+        }
+    }
+}
+
+void RenderRegion::Record(CommandBuffer* commands, uint32_t visible_mask, bool merge_draws)
+{
+    if (staging_.ind.empty()) {
+        return;
+    }
+
+    commands->SetBuffers(vbuffer_, ibuffer_);
+
+    // Extend the current draw while the next visible chunk starts right where it ends. Hidden or empty chunks in
+    // between don't break the run as long as they have no indices.
+    uint32_t run_start = 0;
+    uint32_t run_count = 0;
+    for (int slot = 0; slot < chunk_count; slot++) {
+        if ((visible_mask & (1u << slot)) == 0 || index_count_[slot] == 0) {
+            continue;
+        }
+        commands->chunk_draw_count_++;
+        if (merge_draws && run_count > 0 && run_start + run_count == first_index_[slot]) {
+            run_count += index_count_[slot];
+            continue;
+        }
+        if (run_count > 0) {
+            commands->DrawIndexed(run_count, run_start);
+        }
+        run_start = first_index_[slot];
+        run_count = index_count_[slot];
+    }
+    if (run_count > 0) {
+        commands->DrawIndexed(run_count, run_start);
+    }
+}
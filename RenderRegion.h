@@ -0,0 +1,45 @@
+#pragma once
+#include "types.h"
+#include "GeometryBuilder.h"
+#include "CommandBuffer.h"
+
+struct ID3D11Buffer;
+struct ID3D11Device;
+struct ID3D11DeviceContext;
+
+// A square of chunks sharing one vertex and index buffer. Each chunk owns a sub range of the buffers, so the visible
+// chunks of a region are usually drawn with a single DrawIndexed.
+class RenderRegion
+{
+	public:
+	static constexpr int chunks_x = 4;
+	static constexpr int chunks_y = 4;
+	static constexpr int chunk_count = chunks_x * chunks_y;
+
+	int region_x_;
+	int region_y_;
+	bool dirty_ = false;
+
+	// last mesh of every chunk of the region, indexed by slot (local_x + local_y * chunks_x)
+	GeometryBuilder meshes_[chunk_count];
+	uint32_t first_index_[chunk_count] = {};
+	uint32_t index_count_[chunk_count] = {};
+
+	ID3D11Buffer* vbuffer_ = nullptr;
+	ID3D11Buffer* ibuffer_ = nullptr;
+	uint32_t vertex_capacity_ = 0;
+	uint32_t index_capacity_ = 0;
+	GeometryBuilder staging_;
+
+	RenderRegion(int region_x, int region_y);
+	static int SlotOf(int chunk_x, int chunk_y);
+	void SetChunkMesh(int chunk_x, int chunk_y, GeometryBuilder* mesh);
+	// Concatenates the chunk meshes into staging_ and lays out their index ranges. Touches no D3D object, benchmarks
+	// stop there.
+	void LayoutChunks();
+	// LayoutChunks, then copies staging_ to the buffers. Windows only, see RenderRegionD3D11.cpp.
+	void UpdateGeometryBuffers(ID3D11Device* device, ID3D11DeviceContext* context);
+	// Appends the draws of the visible chunks to commands, and counts them in it. Only reads the region, several
+	// regions can be recorded at the same time on different threads.
+	void Record(CommandBuffer* commands, uint32_t visible_mask, bool merge_draws);
+};
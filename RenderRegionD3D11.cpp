@@ -0,0 +1,62 @@
+#include "RenderRegion.h"
+#include <string.h>
+#include <d3d11.h>
+#include "Instrument.h"
+
+void RenderRegion::UpdateGeometryBuffers(ID3D11Device* device, ID3D11DeviceContext* context)
+{
+    INSTRUMENT_ZONE("RenderRegion::UpdateGeometryBuffers");
+    LayoutChunks();
+
+    if (staging_.ind.empty()) {
+        return;
+    }
+
+    // (Re)create the buffers when they are too small, with some headroom so a few edits don't reallocate every time
+    if (staging_.vert.size() > vertex_capacity_ || staging_.ind.size() > index_capacity_) {
+        if (vbuffer_) {
+            vbuffer_->Release();
+            ibuffer_->Release();
+        }
+        vertex_capacity_ = (uint32_t) staging_.vert.size() * 3 / 2;
+        index_capacity_ = (uint32_t) staging_.ind.size() * 3 / 2;
+        {
+            D3D11_BUFFER_DESC desc =
+            {
+                .ByteWidth = static_cast<UINT>(vertex_capacity_ * sizeof(Vertex)),
+                .Usage = D3D11_USAGE_DYNAMIC,
+                .BindFlags = D3D11_BIND_VERTEX_BUFFER,
+                .CPUAccessFlags = D3D10_CPU_ACCESS_WRITE,
+            };
+
+            device->CreateBuffer(&desc, nullptr, &vbuffer_);
+        }
+        {
+            D3D11_BUFFER_DESC desc =
+            {
+                .ByteWidth = static_cast<UINT>(index_capacity_ * sizeof(uint32_t)),
+                .Usage = D3D11_USAGE_DYNAMIC,
+                .BindFlags = D3D11_BIND_INDEX_BUFFER,
+                .CPUAccessFlags = D3D10_CPU_ACCESS_WRITE,
+            };
+
+            device->CreateBuffer(&desc, nullptr, &ibuffer_);
+        }
+    }
+
+    // Update vertex buffer
+    {
+        D3D11_MAPPED_SUBRESOURCE mapped_resource = {};
+        context->Map(vbuffer_, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
+        memcpy(mapped_resource.pData, staging_.vert.data(), staging_.vert.size() * sizeof(staging_.vert[0]));
+        context->Unmap(vbuffer_, 0);
+    }
+
+    // Update index buffer
+    {
+        D3D11_MAPPED_SUBRESOURCE mapped_resource = {};
+        context->Map(ibuffer_, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
+        memcpy(mapped_resource.pData, staging_.ind.data(), staging_.ind.size() * sizeof(staging_.ind[0]));
+        context->Unmap(ibuffer_, 0);
+    }
+}
@@ -0,0 +1,173 @@
+#include "Replay.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "Game.h"
+#include "FramePacket.h"
+#include "JobPool.h"
+#include "Map.h"
+#include "Timer.h"
+#include "Instrument.h"
+
+namespace Replay
+{
+    // File layout: magic, version, then one Record per frame. Version 2: the player walks unless the fly bit is set,
+    // and d is applied once.
+    static const char magic[4] = { 'R', 'P', 'L', 'Y' };
+    static constexpr uint32_t version = 2;
+
+    struct Record
+    {
+        float delta_time;
+        float mouse_delta_x;
+        float mouse_delta_y;
+        uint32_t keys;
+    };
+
+    // bits of Record::keys
+    constexpr uint32_t key_w = 1 << 0;
+    constexpr uint32_t key_a = 1 << 1;
+    constexpr uint32_t key_s = 1 << 2;
+    constexpr uint32_t key_d = 1 << 3;
+    constexpr uint32_t key_e = 1 << 4;
+    constexpr uint32_t key_q = 1 << 5;
+    constexpr uint32_t key_jump = 1 << 6;
+    constexpr uint32_t key_fly = 1 << 7;
+
+    static FILE* record_file_ = nullptr;
+
+    bool StartRecording(const char* path)
+    {
+        StopRecording();
+        record_file_ = fopen(path, "wb");
+        if (record_file_ == nullptr) {
+            printf("Replay: can't open %s for writing\n", path);
+            return false;
+        }
+        fwrite(magic, sizeof(magic), 1, record_file_);
+        fwrite(&version, sizeof(version), 1, record_file_);
+        return true;
+    }
+
+    bool IsRecording()
+    {
+        return record_file_ != nullptr;
+    }
+
+    void RecordFrame(const Input::State& input, float delta_time)
+    {
+        if (record_file_ == nullptr) {
+            return;
+        }
+        Record record = {
+            .delta_time = delta_time,
+            .mouse_delta_x = input.mouse_delta_x,
+            .mouse_delta_y = input.mouse_delta_y,
+            .keys = (input.w ? key_w : 0) | (input.a ? key_a : 0) | (input.s ? key_s : 0) | (input.d ? key_d : 0)
+                  | (input.e ? key_e : 0) | (input.q ? key_q : 0) | (input.jump ? key_jump : 0) | (input.fly ? key_fly : 0),
+        };
+        fwrite(&record, sizeof(record), 1, record_file_);
+    }
+
+    void StopRecording()
+    {
+        if (record_file_) {
+            fclose(record_file_);
+            record_file_ = nullptr;
+        }
+    }
+
+    bool Load(const char* path, std::vector<Frame>* frames)
+    {
+        FILE* file = fopen(path, "rb");
+        if (file == nullptr) {
+            printf("Replay: can't open %s\n", path);
+            return false;
+        }
+
+        char file_magic[4];
+        uint32_t file_version;
+        if (fread(file_magic, sizeof(file_magic), 1, file) != 1 || memcmp(file_magic, magic, sizeof(magic)) != 0
+            || fread(&file_version, sizeof(file_version), 1, file) != 1 || file_version != version) {
+            printf("Replay: %s is not a replay file, or an older version\n", path);
+            fclose(file);
+            return false;
+        }
+
+        frames->clear();
+        Record record;
+        while (fread(&record, sizeof(record), 1, file) == 1) {
+            Frame frame = {};
+            frame.delta_time = record.delta_time;
+            frame.input.mouse_delta_x = record.mouse_delta_x;
+            frame.input.mouse_delta_y = record.mouse_delta_y;
+            frame.input.w = record.keys & key_w;
+            frame.input.a = record.keys & key_a;
+            frame.input.s = record.keys & key_s;
+            frame.input.d = record.keys & key_d;
+            frame.input.e = record.keys & key_e;
+            frame.input.q = record.keys & key_q;
+            frame.input.jump = record.keys & key_jump;
+            frame.input.fly = record.keys & key_fly;
+            frames->push_back(frame);
+        }
+
+        fclose(file);
+        return true;
+    }
+
+    static double Percentile(const std::vector<double>& sorted, int percent)
+    {
+        size_t index = (sorted.size() * percent + 99) / 100;
+        return sorted[index > 0 ? index - 1 : 0];
+    }
+
+    bool RunHeadless(const char* path)
+    {
+        std::vector<Frame> frames;
+        if (!Load(path, &frames)) {
+            return false;
+        }
+        if (frames.empty()) {
+            printf("Replay: %s has no frames\n", path);
+            return false;
+        }
+
+        JobPool::Init();
+        uint64_t start = Timer::Now();
+        Map::GenerateTerrain();
+        printf("replay %s: %d frames, terrain generated in %.1f ms\n", path, (int) frames.size(), Timer::SecondsSince(start) * 1000.0);
+
+        Game::Init();
+        Instrument::Reset();
+
+        // filled like the window does, to count the copies handed to the render thread, but not drawn
+        FramePacket packet = {};
+        std::vector<double> frame_ms(frames.size());
+        double recorded_seconds = 0;
+        for (size_t i = 0; i < frames.size(); i++) {
+            uint64_t frame_start = Timer::Now();
+            float alpha = Game::Update(frames[i].input, frames[i].delta_time);
+            Game::FillPacket(&packet, alpha);
+            frame_ms[i] = Timer::ToMs(Timer::Now() - frame_start);
+            recorded_seconds += frames[i].delta_time;
+        }
+
+        double total_ms = 0;
+        for (double ms : frame_ms) {
+            total_ms += ms;
+        }
+        std::vector<double> sorted = frame_ms;
+        std::sort(sorted.begin(), sorted.end());
+
+        printf("  %.1f s of recording (%d ticks) simulated in %.1f ms\n", recorded_seconds, Game::tick_count, total_ms);
+        printf("  frame ms: min %.3f, avg %.3f, p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n", sorted.front(), total_ms / frames.size(),
+               Percentile(sorted, 50), Percentile(sorted, 90), Percentile(sorted, 99), sorted.back());
+        // should be the same from one run to the next, otherwise the replay is not deterministic
+        printf("  end state: camera %.3f %.3f %.3f, %d particles\n", Game::camera.pos.x, Game::camera.pos.y, Game::camera.pos.z, Game::particles.ParticleCount());
+
+        printf("\n");
+        Instrument::Print();
+        return true;
+    }
+}
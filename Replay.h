@@ -0,0 +1,24 @@
+#pragma once
+#include <vector>
+#include "Input.h"
+
+// Records the input and frame delta of every frame to a file, and plays such a file back without a window through
+// Game::Update. The same recording gives the same camera path, lods, meshes and particles, so it can be used to compare
+// the cost of a frame between two builds.
+namespace Replay
+{
+	struct Frame
+	{
+		float delta_time;
+		Input::State input;
+	};
+
+	bool StartRecording(const char* path);
+	bool IsRecording();
+	void RecordFrame(const Input::State& input, float delta_time);
+	void StopRecording();
+
+	bool Load(const char* path, std::vector<Frame>* frames);
+	/// Generates the map, plays the recording and prints the frame time distribution. Returns false if the file could not be read.
+	bool RunHeadless(const char* path);
+}
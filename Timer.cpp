@@ -0,0 +1,37 @@
+#include "Timer.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <chrono>
+#endif
+
+namespace Timer
+{
+    uint64_t Now()
+    {
+#ifdef _WIN32
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        return (uint64_t) counter.QuadPart;
+#else
+        return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    uint64_t Frequency()
+    {
+#ifdef _WIN32
+        static uint64_t frequency = [] {
+            LARGE_INTEGER f;
+            QueryPerformanceFrequency(&f);
+            return (uint64_t) f.QuadPart;
+        }();
+        return frequency;
+#else
+        return 1000000000ull;
+#endif
+    }
+}
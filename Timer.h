@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+
+// High resolution clock in ticks, QueryPerformanceCounter on Windows and steady_clock (nanoseconds) elsewhere. The
+// platform calls are in Timer.cpp so including the timer doesn't pull Windows.h and its macros in.
+namespace Timer
+{
+    uint64_t Now();
+    uint64_t Frequency();
+
+    inline double ToSeconds(uint64_t ticks)
+    {
+        return (double) ticks / (double) Frequency();
+    }
+
+    inline double ToMs(uint64_t ticks)
+    {
+        return (double) ticks * 1000.0 / (double) Frequency();
+    }
+
+    inline double SecondsSince(uint64_t start)
+    {
+        return ToSeconds(Now() - start);
+    }
+}